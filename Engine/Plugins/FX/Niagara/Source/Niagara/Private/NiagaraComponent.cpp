@@ -91,6 +91,47 @@ static FAutoConsoleVariableRef CVarNiagaraForceWaitForCompilationOnActivate(
 	ECVF_Default
 );
 
+static int32 GNiagaraThrottleCustomCaptureOnlyTick = 1;
+static FAutoConsoleVariableRef CVarNiagaraThrottleCustomCaptureOnlyTick(
+	TEXT("fx.Niagara.ThrottleCustomCaptureOnlyTick"),
+	GNiagaraThrottleCustomCaptureOnlyTick,
+	TEXT("When enabled solo components only visible in the custom capture tick at the refresh rate of the capture, and not at all while it isn't rendered."),
+	ECVF_Default
+);
+
+/**
+ * Frames between two simulation ticks of a solo component, 0 when it shouldn't tick. Components only seen through the custom capture follow its refresh rate.
+ * The tick function of the component is left alone, see ShouldTickNiagaraSoloOnFrame.
+ */
+static int32 GetNiagaraSoloTickInterval(const UNiagaraComponent* Component)
+{
+	if (!GNiagaraThrottleCustomCaptureOnlyTick || !Component->bRenderCustomCapture || !Component->bVisibleInCustomCaptureOnly)
+	{
+		return 1;
+	}
+
+	// The renderer only updates the last render time of capture-only components on the frames their capture is refreshed and sampled
+	if (!Component->WasRecentlyRendered())
+	{
+		return 0;
+	}
+
+	// Frames are only skipped for components ticking every frame, a component with its own tick interval keeps it
+	if (Component->PrimaryComponentTick.TickInterval > 0.0f)
+	{
+		return 1;
+	}
+
+	static const auto CVarCustomCaptureUpdateInterval = IConsoleManager::Get().FindTConsoleVariableDataInt(TEXT("r.Mobile.CustomCapture.UpdateInterval"));
+	return CVarCustomCaptureUpdateInterval ? FMath::Max(CVarCustomCaptureUpdateInterval->GetValueOnGameThread(), 1) : 1;
+}
+
+/** Whether a component simulating every TickInterval frames ticks this frame, the components are spread over the frames by their unique id. */
+static bool ShouldTickNiagaraSoloOnFrame(const UNiagaraComponent* Component, int32 TickInterval)
+{
+	return TickInterval == 1 || (TickInterval > 1 && (GFrameCounter + Component->GetUniqueID()) % TickInterval == 0);
+}
+
 FAutoConsoleCommandWithWorldAndArgs DumpNiagaraComponentsCommand(
 	TEXT("fx.Niagara.DumpComponents"),
 	TEXT("Dump Information about all Niagara Components"),
@@ -359,6 +400,11 @@ FPrimitiveViewRelevance FNiagaraSceneProxy::GetViewRelevance(const FSceneView* V
 		if (Renderer)
 		{
 			Relevance |= Renderer->GetViewRelevance(View, this);
+
+			if (Relevance.bRenderCustomCapture && Renderer->GetSimTarget() == ENiagaraSimTarget::GPUComputeSim)
+			{
+				Relevance.bCustomCaptureGPUParticles = true;
+			}
 		}
 	}
 
@@ -705,7 +751,13 @@ void UNiagaraComponent::TickComponent(float DeltaSeconds, enum ELevelTick TickTy
 
 		if (AgeUpdateMode == ENiagaraAgeUpdateMode::TickDeltaTime)
 		{
-			SystemInstance->ManualTick(DeltaSeconds, (ThisTickFunction && ThisTickFunction->IsCompletionHandleValid()) ? ThisTickFunction->GetCompletionHandle() : nullptr);
+			// Throttled components simulate once every TickInterval frames and cover the skipped frames with that step.
+			// Not ticking at all while the capture isn't rendered, the paused time is dropped.
+			const int32 TickInterval = GetNiagaraSoloTickInterval(this);
+			if (ShouldTickNiagaraSoloOnFrame(this, TickInterval))
+			{
+				SystemInstance->ManualTick(DeltaSeconds * TickInterval, (ThisTickFunction && ThisTickFunction->IsCompletionHandleValid()) ? ThisTickFunction->GetCompletionHandle() : nullptr);
+			}
 		}
 		else if(AgeUpdateMode == ENiagaraAgeUpdateMode::DesiredAge)
 		{
@@ -139,6 +139,42 @@ struct FRendererStencilMaskEvaluation
 	}
 };
 
+/** Channels of the CustomCapture target a primitive writes to. Each channel is an independent capture layer. */
+USTRUCT(BlueprintType)
+struct FCustomCaptureChannels
+{
+	GENERATED_BODY()
+
+	FCustomCaptureChannels() :
+		bChannel0(true),
+		bChannel1(false),
+		bChannel2(false),
+		bChannel3(false)
+	{}
+
+	/** Capture layer stored in the red channel. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Channels)
+	uint8 bChannel0:1;
+
+	/** Capture layer stored in the green channel. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Channels)
+	uint8 bChannel1:1;
+
+	/** Capture layer stored in the blue channel. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Channels)
+	uint8 bChannel2:1;
+
+	/** Capture layer stored in the alpha channel. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Channels)
+	uint8 bChannel3:1;
+};
+
+/** Converts capture channels to the bit mask the renderer uses, bit N being channel N. */
+FORCEINLINE uint8 GetCustomCaptureChannelMaskForStruct(const FCustomCaptureChannels& Value)
+{
+	return Value.bChannel0 | (Value.bChannel1 << 1) | (Value.bChannel2 << 2) | (Value.bChannel3 << 3);
+}
+
 
 /**
  * Delegate for notification of blocking collision against a specific component.  
@@ -587,6 +623,14 @@ public:
 	UPROPERTY(EditAnywhere, AdvancedDisplay, BlueprintReadOnly, Category=Rendering,  meta=(UIMin = "0", UIMax = "255", editcondition = "bRenderCustomDepth", DisplayName = "CustomDepth Stencil Value"))
 	int32 CustomDepthStencilValue;
 
+	/** Channels of the CustomCapture target this component writes to, all of them are rendered in a single pass. */
+	UPROPERTY(EditAnywhere, AdvancedDisplay, BlueprintReadOnly, Category = Rendering, meta = (editcondition = "bRenderCustomCapture", DisplayName = "CustomCapture Channels"))
+	FCustomCaptureChannels CustomCaptureChannels;
+
+	/** If set, replaces the materials of this component in the CustomCapture pass, so that one shared material can write an id or a value for whole classes of objects. Requires r.Mobile.CustomCapture.MaterialOverrides. */
+	UPROPERTY(EditAnywhere, AdvancedDisplay, BlueprintReadOnly, Category = Rendering, meta = (editcondition = "bRenderCustomCapture", DisplayName = "CustomCapture Material"))
+	UMaterialInterface* CustomCaptureMaterial;
+
 private:
 	/** Optional user defined default values for the custom primitive data of this primitive */
 	UPROPERTY(EditAnywhere, AdvancedDisplay, Category=Rendering, meta = (DisplayName = "Custom Primitive Data Defaults"))
@@ -1642,6 +1686,24 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Rendering")
 	void SetCustomDepthStencilWriteMask(ERendererStencilMask WriteMaskBit);
 
+	/** Sets the CustomCapture material override and marks the render state dirty, the scene proxy caching the material is recreated. */
+	UFUNCTION(BlueprintCallable, Category = "Rendering")
+	void SetCustomCaptureMaterial(UMaterialInterface* Material)
+	{
+		if (CustomCaptureMaterial != Material)
+		{
+			CustomCaptureMaterial = Material;
+			MarkRenderStateDirty();
+		}
+	}
+
+	/**
+	 * Sets the bRenderCustomCapture property without recreating the render state.
+	 * Only the custom capture draw commands of a primitive captured for the first time are cached, the other passes keep theirs.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Rendering")
+	void SetRenderCustomCapture(bool bValue);
+
 	/** Sets bRenderInMainPass property and marks the render state dirty. */
 	UFUNCTION(BlueprintCallable, Category = "Rendering")
 	void SetRenderInMainPass(bool bValue);
@@ -1785,7 +1847,22 @@ public:
 	 * 
 	 * @param OutMaterials	The list of used materials.
 	 */
-	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const {}
+	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const
+	{
+		GetUsedCustomCaptureMaterials(OutMaterials);
+	}
+
+	/**
+	 * Adds the CustomCapture material override to the used materials, so that shader compiling recreates the scene proxy when it changes.
+	 * Overrides of GetUsedMaterials have to call it as well, the capture pass ignores an override missing from the used materials.
+	 */
+	void GetUsedCustomCaptureMaterials(TArray<UMaterialInterface*>& OutMaterials) const
+	{
+		if (CustomCaptureMaterial)
+		{
+			OutMaterials.AddUnique(CustomCaptureMaterial);
+		}
+	}
 
 	/**
 	 * Returns the material textures used to render this primitive for the given platform.
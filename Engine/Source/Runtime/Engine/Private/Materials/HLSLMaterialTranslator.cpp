@@ -808,6 +808,8 @@ bool FHLSLMaterialTranslator::Translate()
 		bAllowCodeChunkGeneration = false;
 
 		bUsesEmissiveColor = IsMaterialPropertyUsed(MP_EmissiveColor, Chunk[MP_EmissiveColor], FLinearColor(0, 0, 0, 0), 3);
+		MaterialCompilationOutput.bHasUniformEmissiveColor = Chunk[MP_EmissiveColor] == INDEX_NONE
+			|| SharedPropertyCodeChunks[FMaterialAttributeDefinitionMap::GetShaderFrequency(MP_EmissiveColor)][Chunk[MP_EmissiveColor]].UniformExpression != nullptr;
 		bUsesPixelDepthOffset = (AllowPixelDepthOffset(Platform) && IsMaterialPropertyUsed(MP_PixelDepthOffset, Chunk[MP_PixelDepthOffset], FLinearColor(0, 0, 0, 0), 1))
 			|| (Domain == MD_DeferredDecal && Material->GetDecalBlendMode() == DBM_Volumetric_DistanceFunction);
 
@@ -154,6 +154,8 @@ FPrimitiveSceneProxy::FPrimitiveSceneProxy(const UPrimitiveComponent* InComponen
 ,	CustomDepthStencilValue(InComponent->CustomDepthStencilValue)
 ,	CustomDepthStencilWriteMask(FRendererStencilMaskEvaluation::ToStencilMask(InComponent->CustomDepthStencilWriteMask))
 ,	LightingChannelMask(GetLightingChannelMaskForStruct(InComponent->LightingChannels))
+,	CustomCaptureChannelMask(GetCustomCaptureChannelMaskForStruct(InComponent->CustomCaptureChannels))
+,	CustomCaptureMaterialProxy(InComponent->CustomCaptureMaterial ? InComponent->CustomCaptureMaterial->GetRenderProxy() : nullptr)
 ,	IndirectLightingCacheQuality(InComponent->IndirectLightingCacheQuality)
 ,	VirtualTextureLodBias(InComponent->VirtualTextureLodBias)
 ,	VirtualTextureCullMips(InComponent->VirtualTextureCullMips)
@@ -536,6 +538,57 @@ void FPrimitiveSceneProxy::SetCustomDepthEnabled_RenderThread(const bool bInRend
 	bRenderCustomDepth = bInRenderCustomDepth;
 }
 
+/**
+* Set the custom capture enabled flag
+*
+* @param the new value
+*/
+void FPrimitiveSceneProxy::SetCustomCaptureEnabled_GameThread(const bool bInRenderCustomCapture)
+{
+	check(IsInGameThread());
+
+	ENQUEUE_RENDER_COMMAND(FSetCustomCaptureEnabled)(
+		[this, bInRenderCustomCapture](FRHICommandList& RHICmdList)
+		{
+			this->SetCustomCaptureEnabled_RenderThread(bInRenderCustomCapture);
+	});
+}
+
+/**
+* Set the custom capture enabled flag (RENDER THREAD)
+*
+* @param the new value
+*/
+void FPrimitiveSceneProxy::SetCustomCaptureEnabled_RenderThread(const bool bInRenderCustomCapture)
+{
+	check(IsInRenderingThread());
+	if (bCustomCapturePass != bInRenderCustomCapture)
+	{
+		bCustomCapturePass = bInRenderCustomCapture;
+
+		// A primitive captured for the first time gets its CustomCapturePass commands cached by the scene before its next visibility pass.
+		// The commands of a primitive captured before are kept while it is off.
+		if (bCustomCapturePass && PrimitiveSceneInfo)
+		{
+			Scene->UpdateCustomCapture_RenderThread(PrimitiveSceneInfo);
+		}
+	}
+}
+
+void UPrimitiveComponent::SetRenderCustomCapture(bool bValue)
+{
+	if (bRenderCustomCapture != bValue)
+	{
+		bRenderCustomCapture = bValue;
+
+		// The render state is kept, the proxy flag is updated by a render command
+		if (SceneProxy)
+		{
+			SceneProxy->SetCustomCaptureEnabled_GameThread(bValue);
+		}
+	}
+}
+
 /**
 * Set the custom depth stencil value
 *
@@ -705,6 +758,17 @@ void FPrimitiveSceneProxy::SetCollisionEnabled_RenderThread(const bool bNewEnabl
 
 /** @return True if the primitive is visible in the given View. */
 bool FPrimitiveSceneProxy::IsShown(const FSceneView* View) const
+{
+	return IsShownInternal(View, false);
+}
+
+/** @return True if the custom capture of the given View draws the primitive, IsShown() hides primitives only visible in the capture. */
+bool FPrimitiveSceneProxy::IsShownInCustomCapture(const FSceneView* View) const
+{
+	return ShouldRenderCustomCapture() && IsShownInternal(View, true);
+}
+
+bool FPrimitiveSceneProxy::IsShownInternal(const FSceneView* View, bool bCustomCapture) const
 {
 #if WITH_EDITOR
 	// Don't draw editor specific actors during game mode
@@ -789,7 +853,7 @@ bool FPrimitiveSceneProxy::IsShown(const FSceneView* View) const
 	}
 	else
 	{
-		if (IsVisibleInSceneCaptureOnly() || IsVisibleInCustomCaptureOnly())
+		if (IsVisibleInSceneCaptureOnly() || (IsVisibleInCustomCaptureOnly() && !bCustomCapture))
 			return false;
 	}
 
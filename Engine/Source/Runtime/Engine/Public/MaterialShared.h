@@ -604,7 +604,8 @@ public:
 		bUsesPixelDepthOffset(false),
 		bUsesDistanceCullFade(false),
 		bHasRuntimeVirtualTextureOutputNode(false),
-		bUsesAnisotropy(false)
+		bUsesAnisotropy(false),
+		bHasUniformEmissiveColor(false)
 	{}
 
 	ENGINE_API bool IsSceneTextureUsed(ESceneTextureId TexId) const { return (UsedSceneTextures & (1 << TexId)) != 0; }
@@ -690,6 +691,12 @@ public:
 
 	/** true if the material uses non 0 anisotropy value */
 	LAYOUT_BITFIELD(uint8, bUsesAnisotropy, 1);
+
+	/**
+	 * true if the emissive color is a uniform expression, it doesn't depend on any vertex or pixel input.
+	 * Changing the fields of this struct changes the serialized shader maps, bump MATERIALSHADERMAP_DERIVEDDATA_VER along with them.
+	 */
+	LAYOUT_BITFIELD(uint8, bHasUniformEmissiveColor, 1);
 };
 
 /** 
@@ -1231,6 +1238,7 @@ public:
 	bool UsesVelocitySceneTexture() const { return GetContent()->MaterialCompilationOutput.UsesVelocitySceneTexture(); }
 	bool UsesDistanceCullFade() const { return GetContent()->MaterialCompilationOutput.bUsesDistanceCullFade; }
 	bool UsesAnisotropy() const { return GetContent()->MaterialCompilationOutput.bUsesAnisotropy; }
+	bool HasUniformEmissiveColor() const { return GetContent()->MaterialCompilationOutput.bHasUniformEmissiveColor; }
 #if WITH_EDITOR
 	uint32 GetNumUsedUVScalars() const { return GetContent()->MaterialCompilationOutput.NumUsedUVScalars; }
 	uint32 GetNumUsedCustomInterpolatorScalars() const { return GetContent()->MaterialCompilationOutput.NumUsedCustomInterpolatorScalars; }
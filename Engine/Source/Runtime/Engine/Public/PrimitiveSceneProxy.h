@@ -164,6 +164,9 @@ public:
 	/** @return True if the primitive is visible in the given View. */
 	ENGINE_API bool IsShown(const FSceneView* View) const;
 
+	/** @return True if the custom capture of the given View draws the primitive, also when it is only visible in the capture. */
+	ENGINE_API bool IsShownInCustomCapture(const FSceneView* View) const;
+
 	/** @return True if the primitive is casting a shadow. */
 	ENGINE_API bool IsShadowCast(const FSceneView* View) const;
 
@@ -434,6 +437,21 @@ public:
 	*/
 	void SetCustomDepthEnabled_RenderThread(const bool bInRenderCustomDepth);
 
+	/**
+	* Set the custom capture enabled flag
+	*
+	* @param the new value
+	*/
+	void SetCustomCaptureEnabled_GameThread(const bool bInRenderCustomCapture);
+
+	/**
+	* Set the custom capture enabled flag (RENDER THREAD)
+	* Only the CustomCapturePass commands of a newly captured primitive are cached, the other passes keep theirs.
+	*
+	* @param the new value
+	*/
+	void SetCustomCaptureEnabled_RenderThread(const bool bInRenderCustomCapture);
+
 	/**
 	* Set the custom depth stencil value
 	*
@@ -566,6 +584,8 @@ public:
 	inline bool IsComponentLevelVisible() const { return bIsComponentLevelVisible; }
 	inline bool ShouldReceiveMobileCSMShadows() const { return bReceiveMobileCSMShadows; }
 	inline bool ShouldRenderCustomCapture() const { return bCustomCapturePass; }
+	inline uint8 GetCustomCaptureChannelMask() const { return CustomCaptureChannelMask; }
+	inline const FMaterialRenderProxy* GetCustomCaptureMaterialProxy() const { return CustomCaptureMaterialProxy; }
 
 	inline void SetPatchingFrameNumber(int32 FrameNumber)
 	{
@@ -999,6 +1019,15 @@ private:
 
 	uint8 LightingChannelMask;
 
+	/** Channels of the custom capture target this primitive writes to, bit N being channel N */
+	uint8 CustomCaptureChannelMask;
+
+	/**
+	 * Replaces the materials of this primitive in the custom capture pass if set. The material is referenced by the component,
+	 * which recreates the proxy when it changes, and is verified against GetUsedMaterials like the materials of the mesh batches.
+	 */
+	const FMaterialRenderProxy* CustomCaptureMaterialProxy;
+
 protected:
 
 	/** Quality of interpolated indirect lighting for Movable components. */
@@ -1025,6 +1054,9 @@ protected:
 	TArray<ERuntimeVirtualTextureMaterialType> RuntimeVirtualTextureMaterialTypes;
 
 private:
+	/** Shared by IsShown() and IsShownInCustomCapture(), primitives only visible in the custom capture are shown to the capture alone. */
+	bool IsShownInternal(const FSceneView* View, bool bCustomCapture) const;
+
 	/** The hierarchy of owners of this primitive.  These must not be dereferenced on the rendering thread, but the pointer values can be used for identification.  */
 	TArray<const AActor*> Owners;
 
@@ -66,6 +66,10 @@ struct FPrimitiveViewRelevance : public FMaterialRelevance
 	uint32 bTranslucentSelfShadow : 1;
 	/** The primitive should render to the custom capture pass. */
 	uint32 bRenderCustomCapture : 1;
+	/** The custom capture draws of the primitive read GPU simulated particle buffers, complete once the FX system rendered the frame. */
+	uint32 bCustomCaptureGPUParticles : 1;
+	/** Set by the renderer for primitives hidden from the view that only its custom capture pass draws, see IsShownInCustomCapture. */
+	uint32 bCustomCaptureOnly : 1;
 	/** 
 	 * Whether this primitive view relevance has been initialized this frame.  
 	 * Primitives that have not had ComputeRelevanceForView called on them (because they were culled) will not be initialized,
@@ -8,6 +8,168 @@
 #include "MeshMaterialShader.h"
 #include "MeshPassProcessor.h"
 #include "MeshPassProcessor.inl"
+#include "MaterialSceneTextureId.h"
+#include "Engine/BlendableInterface.h"
+#include "PostProcess/PostProcessMaterial.h"
+#include "ClearQuad.h"
+#include "RenderGraphUtils.h"
+#include "ScreenRendering.h"
+#include "PipelineStateCache.h"
+#include "PostProcess/SceneFilterRendering.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Custom Capture draws"), STAT_CustomCaptureDraws, STATGROUP_SceneRendering);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Custom Capture merged draws"), STAT_CustomCaptureMergedDraws, STATGROUP_SceneRendering);
+DECLARE_CYCLE_STAT(TEXT("CustomCapture"), STAT_CLP_CustomCapture, STATGROUP_ParallelCommandListMarkers);
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCapture(
+	TEXT("r.Mobile.CustomCapture"),
+	1,
+	TEXT("Whether the project uses the CustomCapture pass, its shaders are only compiled when it does \n ")
+	TEXT("0: Off, no capture shaders are compiled and the lookup always returns black \n ")
+	TEXT("1: On, for the default material, and for every surface material when r.Mobile.CustomCapture.MaterialMode or r.Mobile.CustomCapture.MaterialOverrides need them (default)\n "),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe
+);
+
+bool IsCustomCaptureEnabled()
+{
+	return CVarMobileCustomCapture.GetValueOnAnyThread() != 0;
+}
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureUpdateInterval(
+	TEXT("r.Mobile.CustomCapture.UpdateInterval"),
+	1,
+	TEXT("Refresh the CustomCapture every N frames, the previous capture is kept in between (default 1, every frame)"),
+	ECVF_RenderThreadSafe
+);
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureRotateViews(
+	TEXT("r.Mobile.CustomCapture.RotateViews"),
+	0,
+	TEXT("With several views (split-screen), refresh the CustomCapture of one view at a time \n ")
+	TEXT("0: Off, all views are refreshed together (default)\n ")
+	TEXT("1: On \n "),
+	ECVF_RenderThreadSafe
+);
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureReproject(
+	TEXT("r.Mobile.CustomCapture.Reproject"),
+	1,
+	TEXT("Reproject a CustomCapture kept from a previous frame with the camera rotation since it was rendered, single view only \n ")
+	TEXT("0: Off \n ")
+	TEXT("1: On (default)\n "),
+	ECVF_RenderThreadSafe
+);
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureSceneColorAttachment(
+	TEXT("r.Mobile.CustomCapture.SceneColorAttachment"),
+	0,
+	TEXT("Render the CustomCapture as a second attachment of the mobile scene color render pass, saving a render pass \n ")
+	TEXT("Only used when nothing drawn in the scene color pass samples the capture, the capture resolution is the scene resolution, without MSAA and multi-view. \n ")
+	TEXT("Otherwise the capture is rendered in its own render pass, without a scene color store. \n ")
+	TEXT("0: Off (default)\n ")
+	TEXT("1: On \n "),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe
+);
+
+bool IsCustomCaptureSceneColorAttachmentEnabled()
+{
+	return CVarMobileCustomCaptureSceneColorAttachment.GetValueOnAnyThread() != 0;
+}
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureDepthTest(
+	TEXT("r.Mobile.CustomCapture.DepthTest"),
+	0,
+	TEXT("Depth test the CustomCapture against the scene depth, so that hidden capture pixels are never shaded \n ")
+	TEXT("Only with the full depth prepass, the capture is rendered after it. Without MSAA, multi-view and with a capture resolution scale of 1. \n ")
+	TEXT("The capture draws are built every frame while they are depth tested, otherwise they are not occluded. \n ")
+	TEXT("0: Off (default)\n ")
+	TEXT("1: On \n "),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe
+);
+
+bool IsCustomCaptureDepthTestEnabled()
+{
+	return CVarMobileCustomCaptureDepthTest.GetValueOnAnyThread() != 0;
+}
+
+bool IsCustomCaptureDepthTested(const FScene* Scene)
+{
+	static const auto CVarMobileMSAA = IConsoleManager::Get().FindTConsoleVariableDataInt(TEXT("r.MobileMSAA"));
+	static const auto CVarMobileMultiView = IConsoleManager::Get().FindTConsoleVariableDataInt(TEXT("vr.MobileMultiView"));
+	static const auto CVarResolutionScale = IConsoleManager::Get().FindTConsoleVariableDataFloat(TEXT("r.Mobile.CustomCapture.ResolutionScale"));
+
+	// The full prepass keeps a single sampled scene depth of the scene buffer size, which the capture target matches at full resolution
+	return IsCustomCaptureDepthTestEnabled()
+		&& Scene->EarlyZPassMode == DDM_AllOpaque
+		&& (!CVarMobileMSAA || CVarMobileMSAA->GetValueOnAnyThread() <= 1)
+		&& (!CVarMobileMultiView || CVarMobileMultiView->GetValueOnAnyThread() == 0)
+		&& (!CVarResolutionScale || CVarResolutionScale->GetValueOnAnyThread() >= 1.0f);
+}
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCapturePositionOnly(
+	TEXT("r.Mobile.CustomCapture.PositionOnly"),
+	0,
+	TEXT("Compile position-only capture shaders, used by the opaque materials whose emissive color is a constant or a parameter \n ")
+	TEXT("Only known once a material is translated, so the shaders are compiled for every opaque surface material without vertex work. \n ")
+	TEXT("Meant for projects drawing their captures with such materials, e.g. one ID per material instance. \n ")
+	TEXT("0: Off (default)\n ")
+	TEXT("1: On \n "),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe
+);
+
+static bool IsCustomCapturePositionOnlyEnabled()
+{
+	return CVarMobileCustomCapturePositionOnly.GetValueOnAnyThread() != 0;
+}
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureMaterialMode(
+	TEXT("r.Mobile.CustomCapture.MaterialMode"),
+	0,
+	TEXT("Material the CustomCapture primitives are drawn with \n ")
+	TEXT("The mesh material modes write the emissive color to RGB and the opacity to A of the capture channels of a primitive. \n ")
+	TEXT("0: Default material, the red emissive channel is written to every capture channel (default)\n ")
+	TEXT("1: Mesh material, overwrites the capture \n ")
+	TEXT("2: Mesh material, added to the capture \n ")
+	TEXT("3: Mesh material, blended following the blend mode of the material (translucent, additive or modulate) \n "),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe
+);
+
+ECustomCaptureMaterialMode GetCustomCaptureMaterialMode()
+{
+	return (ECustomCaptureMaterialMode)FMath::Clamp(CVarMobileCustomCaptureMaterialMode.GetValueOnAnyThread(), 0, (int32)ECustomCaptureMaterialMode::MeshTranslucent);
+}
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureMaterialOverrides(
+	TEXT("r.Mobile.CustomCapture.MaterialOverrides"),
+	0,
+	TEXT("Whether components may replace their materials in the CustomCapture with their CustomCapture Material \n ")
+	TEXT("With the default material mode the capture shaders are only compiled for the default material unless overrides are allowed. \n ")
+	TEXT("0: Off, the override is ignored (default)\n ")
+	TEXT("1: On, capture shaders are compiled for every surface material \n "),
+	ECVF_ReadOnly | ECVF_RenderThreadSafe
+);
+
+static bool AreCustomCaptureMaterialOverridesEnabled()
+{
+	return CVarMobileCustomCaptureMaterialOverrides.GetValueOnAnyThread() != 0;
+}
+
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureParallelDrawThreshold(
+	TEXT("r.Mobile.CustomCapture.ParallelDrawThreshold"),
+	256,
+	TEXT("Minimum number of CustomCapture draws of a frame before they are recorded in parallel command lists \n ")
+	TEXT("Every parallel command list begins its own render pass, smaller captures are recorded on the immediate command list. \n ")
+	TEXT("0: Off, always recorded on the immediate command list \n ")
+	TEXT(">0: Draw count threshold (default 256)\n "),
+	ECVF_RenderThreadSafe
+);
+
+/** Returns true if the capture draws are recorded by worker threads, see r.Mobile.CustomCapture.ParallelDrawThreshold. */
+static bool IsCustomCaptureParallelDrawEnabled(int32 NumDraws)
+{
+	const int32 Threshold = CVarMobileCustomCaptureParallelDrawThreshold.GetValueOnRenderThread();
+	return Threshold > 0 && NumDraws >= Threshold && GRHICommandList.UseParallelAlgorithms();
+}
 
 bool IsSupportedVertexFactoryType(const FVertexFactoryType* VertexFactoryType) {
 	if (!VertexFactoryType)
@@ -15,62 +177,68 @@ bool IsSupportedVertexFactoryType(const FVertexFactoryType* VertexFactoryType) {
 		return false;
 	}
 
-	static const FName LocalVfFname(TEXT("FLocalVertexFactory"));
-	static const FName LSkinnedVfFname(TEXT("FGPUSkinPassthroughVertexFactory"));
-	static const FName LGPUSkinFname(TEXT("TGPUSkinVertexFactoryDefault"));
-	static const FName InstancedVfFname(TEXT("FInstancedStaticMeshVertexFactory"));
-	static const FName NiagaraRibbonVfFname(TEXT("FNiagaraRibbonVertexFactory"));
-	static const FName NiagaraSpriteVfFname(TEXT("FNiagaraSpriteVertexFactory"));
-
-	const FName VFName = FName(VertexFactoryType->GetName());
+	// Hashed once and compared against the name hash every vertex factory type keeps, no name lookup per query
+	static const FHashedName SupportedVertexFactoryTypes[] =
+	{
+		FHashedName(TEXT("FLocalVertexFactory")),
+		FHashedName(TEXT("FGPUSkinPassthroughVertexFactory")),
+		// Skeletal meshes outside of the skin cache, skinned again in the capture vertex shader
+		FHashedName(TEXT("TGPUSkinVertexFactoryDefault")),
+		FHashedName(TEXT("FInstancedStaticMeshVertexFactory")),
+		FHashedName(TEXT("FNiagaraMeshVertexFactory")),
+		FHashedName(TEXT("FNiagaraRibbonVertexFactory")),
+		FHashedName(TEXT("FNiagaraSpriteVertexFactory")),
+	};
 
-	if (	VFName == LocalVfFname
-		||	VFName == LSkinnedVfFname
-		||	VFName == LGPUSkinFname
-		||	VFName == InstancedVfFname
-		||	VFName == NiagaraRibbonVfFname
-		||	VFName == NiagaraSpriteVfFname)
+	const FHashedName& VFName = VertexFactoryType->GetHashedName();
+	for (const FHashedName& SupportedName : SupportedVertexFactoryTypes)
 	{
-		return true;
+		if (VFName == SupportedName)
+		{
+			return true;
+		}
 	}
 
 	return false;
 }
-class FPlannarShadowShaderElementData : public FMeshMaterialShaderElementData
+
+/**
+ * The default material mode without overrides only draws the default material, the other surface materials are only drawn
+ * by the mesh material modes or as overrides. Projects without capture strip every permutation with r.Mobile.CustomCapture=0.
+ */
+static bool ShouldCompileCustomCapturePermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
 {
-public:
-	float ShadowBaseHeight;
-};
+	const bool bDrawsSurfaceMaterials = GetCustomCaptureMaterialMode() != ECustomCaptureMaterialMode::Default || AreCustomCaptureMaterialOverridesEnabled();
+
+	return IsCustomCaptureEnabled()
+		&& IsMobilePlatform(Parameters.Platform)
+		&& (Parameters.MaterialParameters.bIsDefaultMaterial || (bDrawsSurfaceMaterials && Parameters.MaterialParameters.MaterialDomain == MD_Surface))
+		&& IsSupportedVertexFactoryType(Parameters.VertexFactoryType);
+}
 
 class FMyPassVS : public FMeshMaterialShader
 {
 	DECLARE_SHADER_TYPE(FMyPassVS, MeshMaterial);
 
-	LAYOUT_FIELD(FShaderParameter, ShadowBaseHeightParameter);
-
+protected:
 	FMyPassVS() {}
 public:
 
 	FMyPassVS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
 		: FMeshMaterialShader(Initializer)
 	{
-		// Bind shader parameter
-		ShadowBaseHeightParameter.Bind(Initializer.ParameterMap, TEXT("ShadowBaseHeight"));
-		//PassUniformBuffer.Bind(Initializer.ParameterMap, FSceneTextureUniformParameters::StaticStructMetadata.GetShaderVariableName());
 	}
 
 	static bool ShouldCompilePermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
 	{
-		return IsMobilePlatform(Parameters.Platform) && IsSupportedVertexFactoryType(Parameters.VertexFactoryType);;
+		return ShouldCompileCustomCapturePermutation(Parameters);
 	}
 
-	void GetShaderBindings(const FScene* Scene, ERHIFeatureLevel::Type FeatureLevel, const FPrimitiveSceneProxy* PrimitiveSceneProxy, const FMaterialRenderProxy& MaterialRenderProxy, const FMaterial& Material, const FMeshPassProcessorRenderState& DrawRenderState, const FPlannarShadowShaderElementData& ShaderElementData, FMeshDrawSingleShaderBindings& ShaderBindings)
+	// Only per-material and per-primitive uniform buffers are bound, so identical capture draws can be merged
+	void GetShaderBindings(const FScene* Scene, ERHIFeatureLevel::Type FeatureLevel, const FPrimitiveSceneProxy* PrimitiveSceneProxy, const FMaterialRenderProxy& MaterialRenderProxy, const FMaterial& Material, const FMeshPassProcessorRenderState& DrawRenderState, const FMeshMaterialShaderElementData& ShaderElementData, FMeshDrawSingleShaderBindings& ShaderBindings)
 	{
 		FMeshMaterialShader::GetShaderBindings(Scene, FeatureLevel, PrimitiveSceneProxy, MaterialRenderProxy, Material, DrawRenderState, ShaderElementData, ShaderBindings);
-		ShaderBindings.Add(ShadowBaseHeightParameter, ShaderElementData.ShadowBaseHeight);
-
 	}
-
 };
 
 class FMyPassPS : public FMeshMaterialShader
@@ -83,12 +251,11 @@ public:
 	FMyPassPS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
 		: FMeshMaterialShader(Initializer)
 	{
-		//PassUniformBuffer.Bind(Initializer.ParameterMap, FMobileSceneTextureUniformParameters::StaticStructMetadata.GetShaderVariableName());
 	}
 
 	static bool ShouldCompilePermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
 	{
-		return IsMobilePlatform(Parameters.Platform) && IsSupportedVertexFactoryType(Parameters.VertexFactoryType);;
+		return ShouldCompileCustomCapturePermutation(Parameters);
 	}
 	void GetShaderBindings(const FScene* Scene, ERHIFeatureLevel::Type FeatureLevel, const FPrimitiveSceneProxy* PrimitiveSceneProxy, const FMaterialRenderProxy& MaterialRenderProxy, const FMaterial& Material, const FMeshPassProcessorRenderState& DrawRenderState, const FMeshMaterialShaderElementData& ShaderElementData, FMeshDrawSingleShaderBindings& ShaderBindings)
 	{
@@ -96,91 +263,951 @@ public:
 	}
 };
 
+/** Writes the capture to the second attachment, see r.Mobile.CustomCapture.SceneColorAttachment. */
+class FMyPassAttachmentPS : public FMyPassPS
+{
+	DECLARE_SHADER_TYPE(FMyPassAttachmentPS, MeshMaterial);
+
+public:
+
+	FMyPassAttachmentPS() { }
+	FMyPassAttachmentPS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
+		: FMyPassPS(Initializer)
+	{
+	}
+
+	static bool ShouldCompilePermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
+	{
+		return FMyPassPS::ShouldCompilePermutation(Parameters) && IsMobilePlatform(Parameters.Platform) && IsCustomCaptureSceneColorAttachmentEnabled();
+	}
+
+	static void ModifyCompilationEnvironment(const FMaterialShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FMyPassPS::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("CUSTOM_CAPTURE_SCENE_COLOR_ATTACHMENT"), 1);
+	}
+};
+
+/** Writes the emissive color and opacity of the mesh material, see r.Mobile.CustomCapture.MaterialMode. */
+class FMyPassMeshMaterialPS : public FMyPassPS
+{
+	DECLARE_SHADER_TYPE(FMyPassMeshMaterialPS, MeshMaterial);
+
+public:
+
+	FMyPassMeshMaterialPS() { }
+	FMyPassMeshMaterialPS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
+		: FMyPassPS(Initializer)
+	{
+	}
+
+	static bool ShouldCompilePermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
+	{
+		return FMyPassPS::ShouldCompilePermutation(Parameters)
+			&& Parameters.MaterialParameters.MaterialDomain == MD_Surface
+			&& GetCustomCaptureMaterialMode() != ECustomCaptureMaterialMode::Default;
+	}
+
+	static void ModifyCompilationEnvironment(const FMaterialShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FMyPassPS::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("CUSTOM_CAPTURE_MESH_MATERIAL"), 1);
+	}
+};
+
+class FMyPassMeshMaterialAttachmentPS : public FMyPassMeshMaterialPS
+{
+	DECLARE_SHADER_TYPE(FMyPassMeshMaterialAttachmentPS, MeshMaterial);
+
+public:
+
+	FMyPassMeshMaterialAttachmentPS() { }
+	FMyPassMeshMaterialAttachmentPS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
+		: FMyPassMeshMaterialPS(Initializer)
+	{
+	}
+
+	static bool ShouldCompilePermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
+	{
+		return FMyPassMeshMaterialPS::ShouldCompilePermutation(Parameters) && IsMobilePlatform(Parameters.Platform) && IsCustomCaptureSceneColorAttachmentEnabled();
+	}
+
+	static void ModifyCompilationEnvironment(const FMaterialShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FMyPassMeshMaterialPS::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("CUSTOM_CAPTURE_SCENE_COLOR_ATTACHMENT"), 1);
+	}
+};
+
+/**
+ * Position-only fast path for opaque materials without vertex work, used when the emissive color of the material is uniform.
+ * The material only tells whether it is once it has been translated, so projects opt in with r.Mobile.CustomCapture.PositionOnly.
+ */
+static bool ShouldCompileCustomCapturePositionOnlyPermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
+{
+	return IsCustomCapturePositionOnlyEnabled()
+		&& ShouldCompileCustomCapturePermutation(Parameters)
+		&& Parameters.VertexFactoryType->SupportsPositionOnly()
+		&& Parameters.MaterialParameters.MaterialDomain == MD_Surface
+		&& Parameters.MaterialParameters.BlendMode == BLEND_Opaque
+		&& !Parameters.MaterialParameters.bMaterialMayModifyMeshPosition;
+}
+
+static void ModifyCustomCapturePositionOnlyCompilationEnvironment(const FMaterialShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	OutEnvironment.SetDefine(TEXT("CUSTOM_CAPTURE_POSITION_ONLY"), 1);
+}
+
+class FMyPassPositionOnlyVS : public FMyPassVS
+{
+	DECLARE_SHADER_TYPE(FMyPassPositionOnlyVS, MeshMaterial);
+
+public:
+
+	FMyPassPositionOnlyVS() { }
+	FMyPassPositionOnlyVS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
+		: FMyPassVS(Initializer)
+	{
+	}
+
+	static bool ShouldCompilePermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
+	{
+		return ShouldCompileCustomCapturePositionOnlyPermutation(Parameters);
+	}
+
+	static void ModifyCompilationEnvironment(const FMaterialShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FMyPassVS::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		ModifyCustomCapturePositionOnlyCompilationEnvironment(Parameters, OutEnvironment);
+	}
+};
+
+/**
+ * Position-only counterpart of each pixel shader above. The outputs are fixed per type and the read-only settings only pick the types
+ * compiled, so the settings end up in the shader map id through its shader types and never in a compilation environment.
+ */
+template<bool bMeshMaterial, bool bSceneColorAttachment>
+class TMyPassPositionOnlyPS : public FMyPassPS
+{
+	DECLARE_SHADER_TYPE(TMyPassPositionOnlyPS, MeshMaterial);
+
+public:
+
+	TMyPassPositionOnlyPS() { }
+	TMyPassPositionOnlyPS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
+		: FMyPassPS(Initializer)
+	{
+	}
+
+	static bool ShouldCompilePermutation(const FMeshMaterialShaderPermutationParameters& Parameters)
+	{
+		return ShouldCompileCustomCapturePositionOnlyPermutation(Parameters)
+			&& bMeshMaterial == (GetCustomCaptureMaterialMode() != ECustomCaptureMaterialMode::Default)
+			&& bSceneColorAttachment == (IsMobilePlatform(Parameters.Platform) && IsCustomCaptureSceneColorAttachmentEnabled());
+	}
+
+	static void ModifyCompilationEnvironment(const FMaterialShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+	{
+		FMyPassPS::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		ModifyCustomCapturePositionOnlyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("CUSTOM_CAPTURE_MESH_MATERIAL"), bMeshMaterial);
+		OutEnvironment.SetDefine(TEXT("CUSTOM_CAPTURE_SCENE_COLOR_ATTACHMENT"), bSceneColorAttachment);
+	}
+};
+
+typedef TMyPassPositionOnlyPS<false, false> FMyPassPositionOnlyPS;
+typedef TMyPassPositionOnlyPS<false, true> FMyPassPositionOnlyAttachmentPS;
+typedef TMyPassPositionOnlyPS<true, false> FMyPassPositionOnlyMeshMaterialPS;
+typedef TMyPassPositionOnlyPS<true, true> FMyPassPositionOnlyMeshMaterialAttachmentPS;
+
 IMPLEMENT_MATERIAL_SHADER_TYPE(, FMyPassVS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("MainVS"), SF_Vertex);
 IMPLEMENT_MATERIAL_SHADER_TYPE(, FMyPassPS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("MainPS"), SF_Pixel);
+IMPLEMENT_MATERIAL_SHADER_TYPE(, FMyPassAttachmentPS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("MainPS"), SF_Pixel);
+IMPLEMENT_MATERIAL_SHADER_TYPE(, FMyPassMeshMaterialPS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("MainPS"), SF_Pixel);
+IMPLEMENT_MATERIAL_SHADER_TYPE(, FMyPassMeshMaterialAttachmentPS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("MainPS"), SF_Pixel);
+IMPLEMENT_MATERIAL_SHADER_TYPE(, FMyPassPositionOnlyVS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("PositionOnlyVS"), SF_Vertex);
+IMPLEMENT_MATERIAL_SHADER_TYPE(template<>, FMyPassPositionOnlyPS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("PositionOnlyPS"), SF_Pixel);
+IMPLEMENT_MATERIAL_SHADER_TYPE(template<>, FMyPassPositionOnlyAttachmentPS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("PositionOnlyPS"), SF_Pixel);
+IMPLEMENT_MATERIAL_SHADER_TYPE(template<>, FMyPassPositionOnlyMeshMaterialPS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("PositionOnlyPS"), SF_Pixel);
+IMPLEMENT_MATERIAL_SHADER_TYPE(template<>, FMyPassPositionOnlyMeshMaterialAttachmentPS, TEXT("/Engine/Private/CustomCapturePass.usf"), TEXT("PositionOnlyPS"), SF_Pixel);
 
-void FMobileSceneRenderer::RenderCustomCapturePass(FRHICommandListImmediate& RHICmdList, const TArrayView<const FViewInfo*> PassViews)
+/** Clears the capture attachment without touching scene color. */
+class FCustomCaptureClearAttachmentPS : public FGlobalShader
 {
-	// do we have primitives in this pass?  
-	bool bPrimitives = false;
+	DECLARE_SHADER_TYPE(FCustomCaptureClearAttachmentPS, Global);
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsMobilePlatform(Parameters.Platform) && IsCustomCaptureSceneColorAttachmentEnabled();
+	}
+
+	FCustomCaptureClearAttachmentPS() {}
+
+public:
+	FCustomCaptureClearAttachmentPS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
+		: FGlobalShader(Initializer)
+	{
+	}
+};
+
+IMPLEMENT_SHADER_TYPE(, FCustomCaptureClearAttachmentPS, TEXT("/Engine/Private/CustomCaptureClearAttachment.usf"), TEXT("MainPS"), SF_Pixel);
+
+void UpdateCustomCaptureDrawStats(const FViewInfo& View, const FMeshCommandOneFrameArray& VisibleMeshDrawCommands, int32 NumDynamicMeshElements)
+{
+#if STATS
+	// Cached commands sharing a state bucket are merged into one instanced draw, dynamic ones are counted as they are
+	int32 NumMergedDraws = VisibleMeshDrawCommands.Num();
+	if (IsDynamicInstancingEnabled(View.GetFeatureLevel()))
+	{
+		TSet<int32, DefaultKeyFuncs<int32>, SceneRenderingSetAllocator> StateBuckets;
+		NumMergedDraws = 0;
+
+		for (const FVisibleMeshDrawCommand& VisibleMeshDrawCommand : VisibleMeshDrawCommands)
+		{
+			bool bAlreadyInSet = false;
+			if (VisibleMeshDrawCommand.StateBucketId != INDEX_NONE)
+			{
+				StateBuckets.Add(VisibleMeshDrawCommand.StateBucketId, &bAlreadyInSet);
+			}
+			NumMergedDraws += bAlreadyInSet ? 0 : 1;
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_CustomCaptureDraws, VisibleMeshDrawCommands.Num() + NumDynamicMeshElements);
+	INC_DWORD_STAT_BY(STAT_CustomCaptureMergedDraws, NumMergedDraws + NumDynamicMeshElements);
+#endif
+}
+
+/** How a capture draw is blended into the target. */
+enum class ECustomCaptureBlend : uint8
+{
+	Opaque,
+	Additive,
+	Translucent,
+	Modulate,
+};
+
+/**
+ * Sorts the capture draws by pipeline state first, then by vertex factory.
+ * Draws of the same mesh end up next to each other and can be merged by dynamic instancing.
+ */
+static FMeshDrawCommandSortKey CalculateCustomCaptureSortKey(
+	const TShaderRef<FMeshMaterialShader>& VertexShader,
+	const TShaderRef<FMeshMaterialShader>& PixelShader,
+	uint8 ChannelMask,
+	ECustomCaptureBlend Blend,
+	const FVertexFactory* VertexFactory)
+{
+	FMeshDrawCommandSortKey SortKey;
+	SortKey.CustomCapture.PixelShaderHash = (PixelShader.IsValid() ? PixelShader->GetSortKey() : 0) & 0xFFFFFF;
+	SortKey.CustomCapture.VertexShaderHash = (VertexShader.IsValid() ? VertexShader->GetSortKey() : 0) & 0xFFFF;
+	SortKey.CustomCapture.BlendState = (ChannelMask & 0xF) | ((uint8)Blend << 4);
+	SortKey.CustomCapture.VertexFactoryHash = PointerHash(VertexFactory) & 0xFFFF;
+	return SortKey;
+}
+
+static ECustomCaptureBlend GetCustomCaptureBlend(ECustomCaptureMaterialMode MaterialMode, EBlendMode BlendMode)
+{
+	switch (MaterialMode)
+	{
+	case ECustomCaptureMaterialMode::MeshAdditive:
+		return ECustomCaptureBlend::Additive;
+	case ECustomCaptureMaterialMode::MeshTranslucent:
+		switch (BlendMode)
+		{
+		case BLEND_Translucent:
+		case BLEND_AlphaComposite:
+		case BLEND_AlphaHoldout:
+			// the pixel shader outputs premultiplied color
+			return ECustomCaptureBlend::Translucent;
+		case BLEND_Additive:
+			return ECustomCaptureBlend::Additive;
+		case BLEND_Modulate:
+			return ECustomCaptureBlend::Modulate;
+		default:
+			return ECustomCaptureBlend::Opaque;
+		}
+	default:
+		return ECustomCaptureBlend::Opaque;
+	}
+}
+
+/** Sort key distance of a blended draw, farther draws come first. */
+static uint32 GetCustomCaptureSortDistance(const FSceneView& View, const FVector& BoundsOrigin)
+{
+	const float Distance = (BoundsOrigin - View.ViewMatrices.GetViewOrigin()).Size();
+	return ~*(const uint32*)&Distance;
+}
+
+/**
+ * Draws overwriting or adding to the capture come first, then blended draws from back to front.
+ * Cached commands have no view, their distance is patched for every view by UpdateCustomCaptureTranslucentSortKeys.
+ */
+static FMeshDrawCommandSortKey CalculateCustomCaptureTranslucentSortKey(
+	const FSceneView* ViewIfDynamicMeshCommand,
+	const FPrimitiveSceneProxy* PrimitiveSceneProxy,
+	const FMeshBatch& MeshBatch,
+	ECustomCaptureBlend Blend)
+{
+	const bool bOrderDependent = Blend == ECustomCaptureBlend::Translucent || Blend == ECustomCaptureBlend::Modulate;
+
+	FMeshDrawCommandSortKey SortKey;
+	SortKey.Translucent.MeshIdInPrimitive = MeshBatch.MeshIdInPrimitive;
+	SortKey.Translucent.Distance = bOrderDependent && ViewIfDynamicMeshCommand ? GetCustomCaptureSortDistance(*ViewIfDynamicMeshCommand, PrimitiveSceneProxy->GetBounds().Origin) : 0;
+	SortKey.Translucent.Priority = bOrderDependent ? 1 : 0;
+	return SortKey;
+}
+
+void UpdateCustomCaptureTranslucentSortKeys(const FScene* Scene, const FViewInfo& View, FMeshCommandOneFrameArray& VisibleMeshDrawCommands)
+{
+	if (GetCustomCaptureMaterialMode() != ECustomCaptureMaterialMode::MeshTranslucent)
+	{
+		return;
+	}
+
+	for (FVisibleMeshDrawCommand& VisibleCommand : VisibleMeshDrawCommands)
+	{
+		// Only blended draws depend on the order, the others keep a distance of 0
+		if (VisibleCommand.SortKey.Translucent.Priority != 0 && VisibleCommand.ScenePrimitiveId >= 0)
+		{
+			VisibleCommand.SortKey.Translucent.Distance = GetCustomCaptureSortDistance(View, Scene->PrimitiveBounds[VisibleCommand.ScenePrimitiveId].BoxSphereBounds.Origin);
+		}
+	}
+}
+
+template<EColorWriteMask RTWriteMask, EBlendOperation BlendOp, EBlendFactor SrcBlend, EBlendFactor DestBlend>
+static FRHIBlendState* GetCustomCaptureBlendStateRHI(bool bSceneColorAttachment)
+{
+	// scene color is the first attachment in the scene color pass, its writes are masked off
+	return bSceneColorAttachment
+		? TStaticBlendState<CW_NONE, BO_Add, BF_One, BF_Zero, BO_Add, BF_One, BF_Zero, RTWriteMask, BlendOp, SrcBlend, DestBlend, BlendOp, SrcBlend, DestBlend>::GetRHI()
+		: TStaticBlendState<RTWriteMask, BlendOp, SrcBlend, DestBlend, BlendOp, SrcBlend, DestBlend>::GetRHI();
+}
+
+template<EColorWriteMask RTWriteMask>
+static FRHIBlendState* GetCustomCaptureBlendStateForMask(ECustomCaptureBlend Blend, bool bSceneColorAttachment)
+{
+	switch (Blend)
+	{
+	case ECustomCaptureBlend::Additive:
+		return GetCustomCaptureBlendStateRHI<RTWriteMask, BO_Add, BF_One, BF_One>(bSceneColorAttachment);
+	case ECustomCaptureBlend::Translucent:
+		return GetCustomCaptureBlendStateRHI<RTWriteMask, BO_Add, BF_One, BF_InverseSourceAlpha>(bSceneColorAttachment);
+	case ECustomCaptureBlend::Modulate:
+		return GetCustomCaptureBlendStateRHI<RTWriteMask, BO_Add, BF_DestColor, BF_Zero>(bSceneColorAttachment);
+	default:
+		return GetCustomCaptureBlendStateRHI<RTWriteMask, BO_Add, BF_One, BF_Zero>(bSceneColorAttachment);
+	}
+}
+
+/** Restricts color writes to the capture channels of a primitive, so that capture layers sharing the target don't overwrite each other. */
+static FRHIBlendState* GetCustomCaptureBlendState(uint8 ChannelMask, ECustomCaptureBlend Blend, bool bSceneColorAttachment)
+{
+#define CUSTOM_CAPTURE_BLEND_STATE(Mask) case Mask: return GetCustomCaptureBlendStateForMask<(EColorWriteMask)Mask>(Blend, bSceneColorAttachment);
+	switch (ChannelMask & CW_RGBA)
+	{
+		CUSTOM_CAPTURE_BLEND_STATE(0x1)
+		CUSTOM_CAPTURE_BLEND_STATE(0x2)
+		CUSTOM_CAPTURE_BLEND_STATE(0x3)
+		CUSTOM_CAPTURE_BLEND_STATE(0x4)
+		CUSTOM_CAPTURE_BLEND_STATE(0x5)
+		CUSTOM_CAPTURE_BLEND_STATE(0x6)
+		CUSTOM_CAPTURE_BLEND_STATE(0x7)
+		CUSTOM_CAPTURE_BLEND_STATE(0x8)
+		CUSTOM_CAPTURE_BLEND_STATE(0x9)
+		CUSTOM_CAPTURE_BLEND_STATE(0xA)
+		CUSTOM_CAPTURE_BLEND_STATE(0xB)
+		CUSTOM_CAPTURE_BLEND_STATE(0xC)
+		CUSTOM_CAPTURE_BLEND_STATE(0xD)
+		CUSTOM_CAPTURE_BLEND_STATE(0xE)
+		CUSTOM_CAPTURE_BLEND_STATE(0xF)
+	default:
+		return nullptr;
+	}
+#undef CUSTOM_CAPTURE_BLEND_STATE
+}
 
-	if (!Scene->World || (Scene->World->WorldType != EWorldType::EditorPreview && Scene->World->WorldType != EWorldType::Inactive))
+bool UsesCustomCaptureLookup(const FScene* Scene, const FViewInfo& View)
+{
+	// Only the mobile renderer draws the capture, the deferred scene texture lookup has no capture and returns black
+	if (!View.bHasCustomCapturePrimitives || !IsCustomCaptureEnabled() || Scene->GetShadingPath() != EShadingPath::Mobile)
 	{
-		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ++ViewIndex)
+		return false;
+	}
+
+	if (Scene->World && (Scene->World->WorldType == EWorldType::EditorPreview || Scene->World->WorldType == EWorldType::Inactive))
+	{
+		return false;
+	}
+
+	// Find out whether any visible material samples the capture
+	if (View.bUsesCustomCaptureInMaterials)
+	{
+		return true;
+	}
+
+	// Find out whether post-process materials sample the capture
+	const FBlendableManager& BlendableManager = View.FinalPostProcessSettings.BlendableManager;
+	FBlendableEntry* BlendableIt = nullptr;
+
+	while (FPostProcessMaterialNode* DataPtr = BlendableManager.IterateBlendables<FPostProcessMaterialNode>(BlendableIt))
+	{
+		if (DataPtr->IsValid())
 		{
-			const FViewInfo& View = Views[ViewIndex];
-			if (View.bHasCustomCapturePrimitives)
+			FMaterialRenderProxy* Proxy = DataPtr->GetMaterialInterface()->GetRenderProxy();
+			check(Proxy);
+
+			const FMaterial& Material = Proxy->GetIncompleteMaterialWithFallback(View.GetFeatureLevel());
+			const FMaterialShaderMap* MaterialShaderMap = Material.GetRenderingThreadShaderMap();
+			if (MaterialShaderMap && MaterialShaderMap->UsesSceneTexture(PPI_CustomCapture))
 			{
-				bPrimitives = true;
-				break;
+				return true;
 			}
 		}
 	}
 
+	return false;
+}
+
+FIntRect ComputeCustomCaptureScreenRect(const FViewInfo& View, const FBoxSphereBounds& Bounds)
+{
+	const FMatrix& ViewProjectionMatrix = View.ViewMatrices.GetViewProjectionMatrix();
+	const FBox Box = Bounds.GetBox();
+
+	FVector2D ScreenMin(FLT_MAX, FLT_MAX);
+	FVector2D ScreenMax(-FLT_MAX, -FLT_MAX);
+
+	for (int32 CornerIndex = 0; CornerIndex < 8; CornerIndex++)
+	{
+		const FVector Corner(
+			(CornerIndex & 1) ? Box.Max.X : Box.Min.X,
+			(CornerIndex & 2) ? Box.Max.Y : Box.Min.Y,
+			(CornerIndex & 4) ? Box.Max.Z : Box.Min.Z);
+
+		const FVector4 ClipPosition = ViewProjectionMatrix.TransformFVector4(FVector4(Corner, 1.0f));
+		if (ClipPosition.W <= KINDA_SMALL_NUMBER)
+		{
+			return View.ViewRect;
+		}
+
+		const FVector2D ScreenPosition(ClipPosition.X / ClipPosition.W, ClipPosition.Y / ClipPosition.W);
+		ScreenMin = FVector2D::Min(ScreenMin, ScreenPosition);
+		ScreenMax = FVector2D::Max(ScreenMax, ScreenPosition);
+	}
+
+	// NDC to pixels, Y is flipped
+	const FVector2D ViewSize(View.ViewRect.Width(), View.ViewRect.Height());
+	FIntRect ScreenRect(
+		View.ViewRect.Min.X + FMath::FloorToInt((ScreenMin.X * 0.5f + 0.5f) * ViewSize.X),
+		View.ViewRect.Min.Y + FMath::FloorToInt((0.5f - ScreenMax.Y * 0.5f) * ViewSize.Y),
+		View.ViewRect.Min.X + FMath::CeilToInt((ScreenMax.X * 0.5f + 0.5f) * ViewSize.X),
+		View.ViewRect.Min.Y + FMath::CeilToInt((0.5f - ScreenMin.Y * 0.5f) * ViewSize.Y));
+	ScreenRect.Clip(View.ViewRect);
+
+	return ScreenRect;
+}
+
+/** Capture rect of a view in capture texels, padded by a texel that bilinear lookups at the edge of the rect read as well. */
+static FIntRect PadCustomCaptureRect(const FIntRect& CaptureRect, const FIntRect& ViewRect, float ResolutionScale)
+{
+	FIntRect PaddedRect = CaptureRect.Scale(ResolutionScale);
+	PaddedRect.InflateRect(1);
+	PaddedRect.Clip(ViewRect.Scale(ResolutionScale));
+	return PaddedRect;
+}
+
+/**
+ * Padded capture rect of a view in capture texels, the capture is drawn and cleared inside of it.
+ * Multi-view draws the second eye along with the first one into its own slice, its rect is added to the one of the first eye at the same place.
+ */
+static FIntRect GetCustomCaptureViewRect(const FViewInfo& View, float ResolutionScale)
+{
+	FIntRect CaptureRect = View.bCustomCaptureValid ? PadCustomCaptureRect(View.CustomCaptureRect, View.ViewRect, ResolutionScale) : FIntRect();
+
+	if (View.bIsMobileMultiViewEnabled && View.Family->Views.Num() > 1)
+	{
+		const FViewInfo& InstancedView = static_cast<const FViewInfo&>(View.Family->GetStereoEyeView(eSSP_RIGHT_EYE));
+		if (&InstancedView != &View && InstancedView.bCustomCaptureValid)
+		{
+			const FIntRect InstancedRect = PadCustomCaptureRect(InstancedView.CustomCaptureRect - (InstancedView.ViewRect.Min - View.ViewRect.Min), View.ViewRect, ResolutionScale);
+
+			if (CaptureRect.Area() > 0)
+			{
+				CaptureRect.Union(InstancedRect);
+			}
+			else
+			{
+				CaptureRect = InstancedRect;
+			}
+		}
+	}
+
+	return CaptureRect;
+}
+
+/** Draws the capture primitives of a view inside of its scaled capture rect, clearing is left to the caller. */
+static void DrawCustomCaptureView(FRHICommandListImmediate& RHICmdList, const FViewInfo& View, const FIntRect& ScissorRect, float ResolutionScale)
+{
+	// Exact fractional viewport, so that capture texels line up with the scaled scene texture UVs used by the lookup
+	RHICmdList.SetViewport(
+		View.ViewRect.Min.X * ResolutionScale, View.ViewRect.Min.Y * ResolutionScale, 0.0f,
+		View.ViewRect.Max.X * ResolutionScale, View.ViewRect.Max.Y * ResolutionScale, 1.0f);
+	RHICmdList.SetScissorRect(true, ScissorRect.Min.X, ScissorRect.Min.Y, ScissorRect.Max.X, ScissorRect.Max.Y);
+	View.ParallelMeshDrawCommandPasses[EMeshPass::CustomCapturePass].DispatchDraw(nullptr, RHICmdList);
+	RHICmdList.SetScissorRect(false, 0, 0, 0, 0);
+}
+
+/**
+ * Updates the last render time of the capture-only components of the refreshed views.
+ * Visibility based culling and tick throttling of their particle systems follow the capture refresh rate this way,
+ * and stop when the capture isn't sampled by anything.
+ */
+static void MarkCustomCaptureOnlyPrimitivesRendered(const TArrayView<const FViewInfo*> PassViews, int32 RefreshViewIndex)
+{
+	for (int32 ViewIndex = 0; ViewIndex < PassViews.Num(); ViewIndex++)
+	{
+		const FViewInfo& View = *PassViews[ViewIndex];
+		if ((RefreshViewIndex == INDEX_NONE || ViewIndex == RefreshViewIndex) && View.bCustomCaptureValid)
+		{
+			for (FPrimitiveSceneInfo* PrimitiveSceneInfo : View.CustomCaptureOnlyPrimitives)
+			{
+				PrimitiveSceneInfo->UpdateComponentLastRenderTime(View.Family->CurrentWorldTime, /*bUpdateLastRenderTimeOnScreen=*/true);
+			}
+		}
+	}
+}
+
+/** Capture setup of a frame, shared by the refresh decision before the pass mesh draw commands are set up and by the pass itself. */
+struct FCustomCaptureFrameSetup
+{
+	/** Whether any view has capture primitives and anything sampling the capture. */
+	bool bPrimitives = false;
+	/** All channels share one target and one render pass. */
+	uint8 ChannelMask = 0;
+	/** Channels the target format holds. */
+	uint8 FormatChannelMask = 0;
+	/** The capture pass draws only to the second color attachment, either in the scene color pass or next to a memoryless first one. */
+	bool bSceneColorAttachment = false;
+	/** Number of slices of a multi-view capture, 0 for a plain 2D capture. */
+	uint32 MultiViewCount = 0;
+	uint32 UpdateInterval = 1;
+	bool bRotateViews = false;
+};
+
+static FCustomCaptureFrameSetup GetCustomCaptureFrameSetup(const TArray<FViewInfo>& Views)
+{
+	FCustomCaptureFrameSetup Setup;
+
+	for (const FViewInfo& View : Views)
+	{
+		if (View.bCustomCaptureValid)
+		{
+			Setup.bPrimitives = true;
+			Setup.ChannelMask |= View.CustomCaptureChannelMask;
+		}
+	}
+
+	Setup.bSceneColorAttachment = IsCustomCaptureSceneColorAttachmentEnabled();
+	// The scene color pass attachment is part of the base pass PSOs, its format may not follow the channels drawn this frame
+	Setup.FormatChannelMask = Setup.bSceneColorAttachment ? (uint8)CW_RGBA : Setup.ChannelMask;
+
+	static const auto CVarMobileMultiView = IConsoleManager::Get().FindTConsoleVariableDataInt(TEXT("vr.MobileMultiView"));
+	const bool bIsMultiViewApplication = (CVarMobileMultiView && CVarMobileMultiView->GetValueOnAnyThread() != 0);
+
+	// Multi-view draws both eyes in one pass, each into its own slice of the capture.
+	// Like the scene color pass, every view of a multi-view application renders into an array.
+	const FViewInfo& FirstView = Views[0];
+	Setup.MultiViewCount = bIsMultiViewApplication ? (FirstView.bIsMobileMultiViewEnabled ? 2 : 1) : 0;
+
+	Setup.UpdateInterval = FMath::Max(CVarMobileCustomCaptureUpdateInterval.GetValueOnRenderThread(), 1);
+	Setup.bRotateViews = CVarMobileCustomCaptureRotateViews.GetValueOnRenderThread() != 0 && Views.Num() > 1 && !Setup.bSceneColorAttachment && !FirstView.bIsMobileMultiViewEnabled;
+
+	return Setup;
+}
+
+void FSceneRenderer::SetupCustomCaptureRefresh(FRHICommandListImmediate& RHICmdList)
+{
+	for (FViewInfo& View : Views)
+	{
+		View.bCustomCaptureRefresh = true;
+	}
+
+	const FCustomCaptureFrameSetup Setup = GetCustomCaptureFrameSetup(Views);
+	if (!Setup.bPrimitives || (Setup.UpdateInterval <= 1 && !Setup.bRotateViews))
+	{
+		return;
+	}
+
+	// The kept capture is only reused by the views it was rendered for, a new target or another view family starts over
 	FSceneRenderTargets& SceneContext = FSceneRenderTargets::Get(RHICmdList);
-	const FCustomCaptureTextures CustomCaptureTextures = SceneContext.RequestCustomCapture(RHICmdList, bPrimitives);
+	const uint32 ViewKey = Views[0].ViewState ? Views[0].ViewState->GetViewKey() : 0;
+	if (ViewKey == 0 || ViewKey != SceneContext.CustomCaptureViewKey || !SceneContext.CanReuseCustomCapture(Setup.FormatChannelMask, Setup.MultiViewCount))
+	{
+		return;
+	}
+
+	if (ViewFamily.FrameNumber - SceneContext.CustomCaptureFrameNumber < Setup.UpdateInterval)
+	{
+		// Materials keep sampling the previous capture, the pass isn't set up at all
+		for (FViewInfo& View : Views)
+		{
+			View.bCustomCaptureRefresh = false;
+		}
+	}
+	else if (Setup.bRotateViews)
+	{
+		// The target holds a capture of every view, rotating refreshes redraw a single view on top of the others
+		const int32 RefreshViewIndex = (int32)(SceneContext.CustomCaptureRotatedView++ % Views.Num());
+		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+		{
+			Views[ViewIndex].bCustomCaptureRefresh = ViewIndex == RefreshViewIndex;
+		}
+	}
+}
+
+void FMobileSceneRenderer::RenderCustomCapturePass(FRDGBuilder& GraphBuilder, const TArrayView<const FViewInfo*> PassViews)
+{
+	// do we have primitives in this pass and anything reading the result?
+	// bCustomCaptureValid and bCustomCaptureRefresh were resolved in InitViews, before the pass mesh draw commands were set up.
+	const FCustomCaptureFrameSetup Setup = GetCustomCaptureFrameSetup(Views);
+	// materials drawn in the scene color pass can't sample an attachment of that pass
+	bool bUsesCustomCaptureInMaterials = false;
+	// capture draws of the rendered views
+	int32 NumDraws = 0;
+	// views drawn this frame, all of them unless a single view is refreshed
+	int32 NumRefreshedViews = 0;
+	int32 RefreshViewIndex = INDEX_NONE;
+
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ++ViewIndex)
+	{
+		const FViewInfo& View = Views[ViewIndex];
+		if (View.bCustomCaptureRefresh)
+		{
+			NumRefreshedViews++;
+			RefreshViewIndex = ViewIndex;
+		}
+		if (View.bCustomCaptureValid)
+		{
+			// The draws of a second eye drawn along with the first one are part of the first eye
+			if (View.ShouldRenderView() && View.bCustomCaptureRefresh)
+			{
+				NumDraws += View.NumCustomCaptureDraws;
+			}
+			bUsesCustomCaptureInMaterials |= View.bUsesCustomCaptureInMaterials;
+		}
+	}
+	// Either all views are refreshed, a single rotating one or none of them
+	if (NumRefreshedViews == Views.Num())
+	{
+		RefreshViewIndex = INDEX_NONE;
+	}
+
+	const bool bSceneColorAttachment = Setup.bSceneColorAttachment;
+	const uint32 MultiViewCount = Setup.MultiViewCount;
+	const uint32 UpdateInterval = Setup.UpdateInterval;
+	const bool bRotateViews = Setup.bRotateViews;
+	// A capture rendered after the FX system is sampled by the materials of the next frame drawn before it
+	const bool bKeepHistory = UpdateInterval > 1 || bRotateViews || (bRenderCustomCaptureAfterFX && bUsesCustomCaptureInMaterials);
+
+	FSceneRenderTargets& SceneContext = FSceneRenderTargets::Get(GraphBuilder.RHICmdList);
+	const FCustomCaptureTextures CustomCaptureTextures = SceneContext.RequestCustomCapture(GraphBuilder, Setup.bPrimitives, Setup.FormatChannelMask, bKeepHistory, bSceneColorAttachment, MultiViewCount);
+
+	if (!CustomCaptureTextures.CustomColor)
+	{
+		return;
+	}
+
+	const FViewInfo& FirstView = Views[0];
+	const uint32 ViewKey = FirstView.ViewState ? FirstView.ViewState->GetViewKey() : 0;
+
+	if (NumRefreshedViews < Views.Num() && !CustomCaptureTextures.bHistoryValid)
+	{
+		// The views that aren't refreshed have no capture in the new target, the lookup returns black and the next frame refreshes all of them
+		SceneContext.CustomCaptureViewKey = 0;
+		SceneContext.CustomCaptureViewUVRects.Reset();
+		SceneContext.SetCustomCaptureView(INDEX_NONE);
+		return;
+	}
 
-	if (CustomCaptureTextures.CustomColor)
+	if (NumRefreshedViews == 0)
 	{
-		SCOPED_DRAW_EVENT(RHICmdList, CustomCapturePass);
+		// Keep the previous capture, materials keep sampling it
+		SceneContext.bCustomCaptureReproject = Views.Num() == 1 && CVarMobileCustomCaptureReproject.GetValueOnRenderThread() != 0;
+		SceneContext.CustomCaptureClipToCaptureClip = FirstView.ViewMatrices.GetInvViewProjectionMatrix() * SceneContext.CustomCaptureViewProjectionMatrix;
+		return;
+	}
 
-		//TRefCountPtr<FRHIUniformBuffer> SceneTexturesUniformBuffer = CreateMobileSceneTextureUniformBuffer(RHICmdList, EMobileSceneTextureSetupMode::CustomCapture);
-		//SCOPED_UNIFORM_BUFFER_GLOBAL_BINDINGS(RHICmdList, SceneTexturesUniformBuffer);
+	SceneContext.bCustomCaptureReproject = false;
+	SceneContext.CustomCaptureClipToCaptureClip = FMatrix::Identity;
+	SceneContext.CustomCaptureViewKey = ViewKey;
+	SceneContext.CustomCaptureFrameNumber = ViewFamily.FrameNumber;
+	SceneContext.CustomCaptureViewProjectionMatrix = FirstView.ViewMatrices.GetViewProjectionMatrix();
 
-		RHICmdList.Transition(FRHITransitionInfo(CustomCaptureTextures.CustomColor, ERHIAccess::SRVGraphics, ERHIAccess::RTV));
+	MarkCustomCaptureOnlyPrimitivesRendered(PassViews, RefreshViewIndex);
 
-		FRHIRenderPassInfo RPInfo(CustomCaptureTextures.CustomColor, ERenderTargetActions::Clear_Store);
-		RHICmdList.BeginRenderPass(RPInfo, TEXT("CustomCaptureRendering"));
+	// The lookup of each view is limited to its own capture rect, texels outside of it are never written and read as black without sampling.
+	// Views are refreshed at different times when rotating, each view rect is cleared in full.
+	const FVector2D CaptureBufferSize = FVector2D(SceneContext.GetBufferSizeXY()) * CustomCaptureTextures.ResolutionScale;
+	SceneContext.CustomCaptureViewUVRects.Reset();
+	SceneContext.CustomCaptureViewUVRects.SetNumZeroed(Views.Num());
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ++ViewIndex)
+	{
+		const FViewInfo& View = Views[ViewIndex];
+		const FIntRect ViewCaptureRect = bRotateViews ? View.ViewRect.Scale(CustomCaptureTextures.ResolutionScale) : GetCustomCaptureViewRect(View, CustomCaptureTextures.ResolutionScale);
+		if (ViewCaptureRect.Area() > 0)
+		{
+			// Half a texel inside of the cleared rect, bilinear lookups stay inside of it
+			const float Inset = bRotateViews ? 0.0f : 0.5f;
+			SceneContext.CustomCaptureViewUVRects[ViewIndex] = FVector4(
+				(ViewCaptureRect.Min.X + Inset) / CaptureBufferSize.X,
+				(ViewCaptureRect.Min.Y + Inset) / CaptureBufferSize.Y,
+				(ViewCaptureRect.Max.X - Inset) / CaptureBufferSize.X,
+				(ViewCaptureRect.Max.Y - Inset) / CaptureBufferSize.Y);
+		}
+	}
 
+	if (bSceneColorAttachment)
+	{
+		// Both attachments of the scene color pass need the same size and sample count
+		bRenderCustomCaptureInSceneColorPass =
+			CanRenderCustomCaptureInSceneColorPass()
+			&& !bUsesCustomCaptureInMaterials
+			&& !bRenderCustomCaptureAfterFX
+			&& CustomCaptureTextures.CustomColor->Desc.Extent == SceneContext.GetBufferSizeXY();
+
+		if (bRenderCustomCaptureInSceneColorPass)
+		{
+			// Drawn at the end of the scene color pass, until then nothing may sample it
+			SceneContext.bCustomCaptureAttached = true;
+			return;
+		}
+	}
+
+	RDG_EVENT_SCOPE(GraphBuilder, "CustomCapturePass");
+
+	// The draws of the pass were built depth tested, the scene depth kept by the full prepass has to be bound
+	FRDGTextureRef SceneDepthTexture = nullptr;
+	if (IsCustomCaptureDepthTested(Scene))
+	{
+		check(SceneContext.SceneDepthZ && (SceneContext.SceneDepthZ->GetDesc().Flags & TexCreate_Memoryless) == 0);
+		check(CustomCaptureTextures.CustomColor->Desc.Extent == SceneContext.SceneDepthZ->GetDesc().Extent);
+		SceneDepthTexture = TryRegisterExternalTexture(GraphBuilder, SceneContext.SceneDepthZ);
+	}
+
+	// Large captures are recorded by worker threads, every parallel command list begins its own render pass
+	const bool bParallelDraw = RefreshViewIndex == INDEX_NONE && IsCustomCaptureParallelDrawEnabled(NumDraws);
+
+	// Only the capture rect of each view is cleared and drawn, the rest of the target is left undefined
+	// unless a single view is refreshed, then the other views are kept.
+	// A multi-view or parallel pass clears the whole target with its load action instead of a quad per view.
+	const bool bClearWithLoadAction = (MultiViewCount > 0 || bParallelDraw) && RefreshViewIndex == INDEX_NONE;
+	const ERenderTargetLoadAction LoadAction = bClearWithLoadAction ? ERenderTargetLoadAction::EClear
+		: (RefreshViewIndex == INDEX_NONE ? ERenderTargetLoadAction::ENoAction : ERenderTargetLoadAction::ELoad);
+
+	FRenderTargetParameters* PassParameters = GraphBuilder.AllocParameters<FRenderTargetParameters>();
+	if (bSceneColorAttachment)
+	{
+		// Stands in for scene color, never loaded nor stored
+		const FIntPoint DummyExtent = CustomCaptureTextures.CustomColor->Desc.Extent;
+		const FRDGTextureDesc DummyDesc = MultiViewCount > 0
+			? FRDGTextureDesc::Create2DArray(DummyExtent, PF_B8G8R8A8, FClearValueBinding::Black, TexCreate_RenderTargetable | TexCreate_Memoryless, MultiViewCount)
+			: FRDGTextureDesc::Create2D(DummyExtent, PF_B8G8R8A8, FClearValueBinding::Black, TexCreate_RenderTargetable | TexCreate_Memoryless);
+		PassParameters->RenderTargets[0] = FRenderTargetBinding(GraphBuilder.CreateTexture(DummyDesc, TEXT("CustomCaptureDummyColor")), ERenderTargetLoadAction::ENoAction);
+		PassParameters->RenderTargets[1] = FRenderTargetBinding(CustomCaptureTextures.CustomColor, LoadAction);
+	}
+	else
+	{
+		PassParameters->RenderTargets[0] = FRenderTargetBinding(CustomCaptureTextures.CustomColor, LoadAction);
+	}
+	PassParameters->RenderTargets.MultiViewCount = MultiViewCount;
+
+	if (SceneDepthTexture)
+	{
+		PassParameters->RenderTargets.DepthStencil = FDepthStencilBinding(
+			SceneDepthTexture,
+			ERenderTargetLoadAction::ELoad,
+			ERenderTargetLoadAction::ENoAction,
+			FExclusiveDepthStencil::DepthRead_StencilNop);
+	}
+
+	if (bParallelDraw)
+	{
+		// Every view is recorded in one pass, the first parallel render pass clears the target and the following ones load it
+		GraphBuilder.AddPass(
+			RDG_EVENT_NAME("CustomCaptureRenderingParallel"),
+			PassParameters,
+			ERDGPassFlags::Raster | ERDGPassFlags::SkipRenderPass,
+			[this, PassViews, PassParameters, ResolutionScale = CustomCaptureTextures.ResolutionScale](FRHICommandListImmediate& RHICmdList)
+		{
+			FParallelCommandListBindings Bindings(PassParameters);
+			bool bCleared = false;
+
+			for (const FViewInfo* PassView : PassViews)
+			{
+				const FViewInfo& View = *PassView;
+				const FParallelMeshDrawCommandPass& CustomCapturePass = View.ParallelMeshDrawCommandPasses[EMeshPass::CustomCapturePass];
+				if (!View.ShouldRenderView() || !View.bCustomCaptureValid || !CustomCapturePass.HasAnyDraw())
+				{
+					continue;
+				}
+
+				// The capture draws only bind the view uniform buffer
+				Scene->UniformBuffers.UpdateViewUniformBuffer(View);
+
+				// The whole target was cleared, the draws are not scissored to the capture rect
+				FRDGParallelCommandListSet ParallelCommandListSet(RHICmdList, GET_STATID(STAT_CLP_CustomCapture), *this, View, Bindings, ResolutionScale);
+				ParallelCommandListSet.SetClearInFirstCommandListOnly();
+				CustomCapturePass.DispatchDraw(&ParallelCommandListSet, RHICmdList);
+
+				Bindings.LoadClearedColorRenderTargets();
+				bCleared = true;
+			}
+
+			if (!bCleared)
+			{
+				RHICmdList.BeginRenderPass(Bindings.RenderPassInfo, TEXT("CustomCaptureClear"));
+				RHICmdList.EndRenderPass();
+			}
+		});
+		return;
+	}
+
+	// All views are drawn in one raster pass, a single tile load/store on mobile
+	GraphBuilder.AddPass(
+		RDG_EVENT_NAME("CustomCaptureRendering"),
+		PassParameters,
+		ERDGPassFlags::Raster,
+		[this, PassViews, RefreshViewIndex, bRotateViews, bClearWithLoadAction, ResolutionScale = CustomCaptureTextures.ResolutionScale](FRHICommandListImmediate& RHICmdList)
+	{
 		for (int32 ViewIndex = 0; ViewIndex < PassViews.Num(); ViewIndex++)
 		{
 			const FViewInfo& View = *PassViews[ViewIndex];
-			if (!View.ShouldRenderView())
+			if (RefreshViewIndex != INDEX_NONE && ViewIndex != RefreshViewIndex)
+			{
+				continue;
+			}
+
+			// A rotating view without capture primitives is cleared all the same, its lookup covers the whole view rect
+			if (!View.ShouldRenderView() || (!View.bCustomCaptureValid && !bRotateViews))
 			{
 				continue;
 			}
 
-			if (Scene->UniformBuffers.UpdateViewUniformBuffer(View))
+			const FIntRect ScissorRect = GetCustomCaptureViewRect(View, ResolutionScale);
+			const FIntRect ClearRect = bRotateViews ? View.ViewRect.Scale(ResolutionScale) : ScissorRect;
+			if (!bClearWithLoadAction && ClearRect.Area() > 0)
 			{
-				UpdateOpaqueBasePassUniformBuffer(RHICmdList, View);
-				UpdateTranslucentBasePassUniformBuffer(RHICmdList, View);
+				RHICmdList.SetViewport(ClearRect.Min.X, ClearRect.Min.Y, 0.0f, ClearRect.Max.X, ClearRect.Max.Y, 1.0f);
+				DrawClearQuad(RHICmdList, FLinearColor::Black);
 			}
-			
-			RHICmdList.SetViewport(View.ViewRect.Min.X, View.ViewRect.Min.Y, 0, View.ViewRect.Max.X, View.ViewRect.Max.Y, 1);
-			View.ParallelMeshDrawCommandPasses[EMeshPass::CustomCapturePass].DispatchDraw(nullptr, RHICmdList);
-
-			//RDG_EVENT_SCOPE_CONDITIONAL(GraphBuilder, PassViews.Num() > 1, "View%d", ViewIndex);
-			//FRDGBuilder GraphBuilder(RHICmdList);
-			// Only clear once the target for every views it contains.
-			//ERenderTargetLoadAction LoadAction = ERenderTargetLoadAction::EClear;
-			//FRenderTargetParameters* PassParameters = GraphBuilder.AllocParameters<FRenderTargetParameters>();
-			//PassParameters->RenderTargets[0] = FRenderTargetBinding(CustomCaptureTextures.CustomColor, LoadAction);
-			////PassParameters->RenderTargets.DepthStencil = FDepthStencilBinding();
-
-			//// Next pass, do not clear the shared target, only render into it
-			//LoadAction = ERenderTargetLoadAction::ELoad;
-			//
-			//GraphBuilder.AddPass(
-			//	RDG_EVENT_NAME("CustomCapture"),
-			//	PassParameters,
-			//	ERDGPassFlags::Raster,
-			//	[this, &View](FRHICommandListImmediate& RHICmdList)
-			//	{
-			//		FSceneRenderTargets& SceneContext = FSceneRenderTargets::Get(RHICmdList);
-
-			//		Scene->UniformBuffers.CustomDepthViewUniformBuffer.UpdateUniformBufferImmediate(*View.CachedViewUniformShaderParameters);
-			//		// If we don't render this pass in stereo we simply update the buffer with the same view uniform parameters.
-			//		Scene->UniformBuffers.InstancedCustomDepthViewUniformBuffer.UpdateUniformBufferImmediate(reinterpret_cast<FInstancedViewUniformShaderParameters&>(*View.CachedViewUniformShaderParameters));
-
-			//		View.ParallelMeshDrawCommandPasses[EMeshPass::CustomCapturePass].DispatchDraw(nullptr, RHICmdList);
-			//	});
 
+			if (View.bCustomCaptureValid && ScissorRect.Area() > 0)
+			{
+				// The capture draws only bind the view uniform buffer
+				Scene->UniformBuffers.UpdateViewUniformBuffer(View);
+				DrawCustomCaptureView(RHICmdList, View, ScissorRect, ResolutionScale);
+			}
+		}
+	});
+}
+
+void FMobileSceneRenderer::UseCustomCaptureHistoryUntilRendered(FRHICommandListImmediate& RHICmdList)
+{
+	FSceneRenderTargets& SceneContext = FSceneRenderTargets::Get(RHICmdList);
+	const FViewInfo& FirstView = Views[0];
+	const uint32 ViewKey = FirstView.ViewState ? FirstView.ViewState->GetViewKey() : 0;
+
+	if (SceneContext.CustomCapture && ViewKey != 0 && ViewKey == SceneContext.CustomCaptureViewKey)
+	{
+		// Same as a capture kept between refreshes, reprojected with the camera motion since it was rendered
+		SceneContext.bCustomCaptureReproject = Views.Num() == 1 && CVarMobileCustomCaptureReproject.GetValueOnRenderThread() != 0;
+		SceneContext.CustomCaptureClipToCaptureClip = FirstView.ViewMatrices.GetInvViewProjectionMatrix() * SceneContext.CustomCaptureViewProjectionMatrix;
+	}
+	else
+	{
+		// The target holds the capture of other views or nothing at all, the lookup returns black until the capture is rendered
+		SceneContext.CustomCaptureViewUVRects.Reset();
+		SceneContext.SetCustomCaptureView(INDEX_NONE);
+	}
+}
+
+bool FMobileSceneRenderer::CanRenderCustomCaptureInSceneColorPass() const
+{
+	static const auto CVarMobileMultiView = IConsoleManager::Get().FindTConsoleVariableDataInt(TEXT("vr.MobileMultiView"));
+	const bool bIsMultiViewApplication = (CVarMobileMultiView && CVarMobileMultiView->GetValueOnAnyThread() != 0);
+
+	// Only depends on the configuration, the layout of the scene color pass stays the same from frame to frame
+	return IsCustomCaptureSceneColorAttachmentEnabled()
+		&& !bDeferredShading
+		&& (!bGammaSpace || bRenderToSceneColor)
+		&& NumMSAASamples <= 1
+		&& !bIsMultiViewApplication;
+}
+
+void FMobileSceneRenderer::RenderCustomCaptureInSceneColorPass(FRHICommandListImmediate& RHICmdList, const TArrayView<const FViewInfo*> PassViews)
+{
+	check(RHICmdList.IsInsideRenderPass());
+
+	SCOPED_DRAW_EVENT(RHICmdList, CustomCapturePass);
+
+	FSceneRenderTargets& SceneContext = FSceneRenderTargets::Get(RHICmdList);
+
+	for (int32 ViewIndex = 0; ViewIndex < PassViews.Num(); ViewIndex++)
+	{
+		const FViewInfo& View = *PassViews[ViewIndex];
+		if (!View.ShouldRenderView() || !View.bCustomCaptureValid)
+		{
+			continue;
+		}
+
+		// The capture is drawn at the scene resolution in this mode
+		const FIntRect ScissorRect = GetCustomCaptureViewRect(View, 1.0f);
+		if (ScissorRect.Area() <= 0)
+		{
+			continue;
 		}
 
-		RHICmdList.EndRenderPass();
+		Scene->UniformBuffers.UpdateViewUniformBuffer(View);
+
+		// Earlier draws of the pass may have left anything in the capture attachment, clear the capture rect of the view
+		{
+			FGraphicsPipelineStateInitializer GraphicsPSOInit;
+			RHICmdList.ApplyCachedRenderTargets(GraphicsPSOInit);
+			GraphicsPSOInit.BlendState = TStaticBlendStateWriteMask<CW_NONE, CW_RGBA>::GetRHI();
+			GraphicsPSOInit.RasterizerState = TStaticRasterizerState<>::GetRHI();
+			GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
 
-		RHICmdList.Transition(FRHITransitionInfo(CustomCaptureTextures.CustomColor, ERHIAccess::RTV, ERHIAccess::SRVGraphics));
+			TShaderMapRef<FScreenVS> VertexShader(View.ShaderMap);
+			TShaderMapRef<FCustomCaptureClearAttachmentPS> PixelShader(View.ShaderMap);
+
+			extern TGlobalResource<FFilterVertexDeclaration> GFilterVertexDeclaration;
+			GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GFilterVertexDeclaration.VertexDeclarationRHI;
+			GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+			GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+			GraphicsPSOInit.PrimitiveType = PT_TriangleList;
+
+			SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit);
+
+			const FIntPoint BufferSize = SceneContext.GetBufferSizeXY();
+			RHICmdList.SetViewport(ScissorRect.Min.X, ScissorRect.Min.Y, 0.0f, ScissorRect.Max.X, ScissorRect.Max.Y, 1.0f);
+
+			DrawRectangle(
+				RHICmdList,
+				0, 0,
+				ScissorRect.Width(), ScissorRect.Height(),
+				ScissorRect.Min.X, ScissorRect.Min.Y,
+				ScissorRect.Width(), ScissorRect.Height(),
+				ScissorRect.Size(),
+				BufferSize,
+				VertexShader,
+				EDRF_UseTriangleOptimization);
+		}
+
+		DrawCustomCaptureView(RHICmdList, View, ScissorRect, 1.0f);
 	}
+
+	// Later passes read the capture
+	SceneContext.bCustomCaptureAttached = false;
 }
 
 FMyPassProcessor::FMyPassProcessor(
@@ -198,72 +1225,105 @@ FMyPassProcessor::FMyPassProcessor(
 	)
 	, bRespectUseAsOccluderFlag(InbRespectUseAsOccluderFlag)
 	, bEarlyZPassMoveable(InbEarlyZPassMoveabe)
+	, bSceneColorAttachment(IsCustomCaptureSceneColorAttachmentEnabled())
+	// Cached draws can't follow the runtime settings, they are never depth tested
+	, bDepthTest(InViewIfDynamicMeshCommand && IsCustomCaptureDepthTested(Scene))
+	, MaterialMode(GetCustomCaptureMaterialMode())
 {
 	PassDrawRenderState.SetViewUniformBuffer(Scene->UniformBuffers.ViewUniformBuffer);
 	PassDrawRenderState.SetInstancedViewUniformBuffer(Scene->UniformBuffers.InstancedViewUniformBuffer);
+	//scene textures are bound through their static slot, the capture shaders read no pass uniform buffer
+	//blend state is picked per primitive from its capture channels
 	PassDrawRenderState.SetBlendState(TStaticBlendState<CW_RGBA>::GetRHI());
-	//need no depth
-	PassDrawRenderState.SetDepthStencilState(TStaticDepthStencilState<false, CF_Never>::GetRHI());
+	//never writes depth, only tested against the scene depth when the pass binds it
+	if (bDepthTest)
+	{
+		PassDrawRenderState.SetDepthStencilState(TStaticDepthStencilState<false, CF_DepthNearOrEqual>::GetRHI());
+	}
+	else
+	{
+		PassDrawRenderState.SetDepthStencilState(TStaticDepthStencilState<false, CF_Always>::GetRHI());
+	}
 }
 
 void FMyPassProcessor::AddMeshBatch(const FMeshBatch& RESTRICT MeshBatch, uint64 BatchElementMask, const FPrimitiveSceneProxy* RESTRICT PrimitiveSceneProxy, int32 StaticMeshId)
 {
 	const FMaterialRenderProxy* FallbackMaterialRenderProxyPtr = nullptr;
 	const FMaterial& Material = MeshBatch.MaterialRenderProxy->GetMaterialWithFallback(Scene->GetFeatureLevel(), FallbackMaterialRenderProxyPtr);
-	const FMaterialRenderProxy& MaterialRenderProxy = FallbackMaterialRenderProxyPtr ? *FallbackMaterialRenderProxyPtr : *MeshBatch.MaterialRenderProxy;
-	/* if use MeshBatch's mateiril
-	const EBlendMode BlendMode = Material.GetBlendMode();
-	const bool bIsTranslucent = IsTranslucentBlendMode(BlendMode);
-	if (bIsTranslucent)
-	{
-		PassDrawRenderState.SetBlendState(TStaticBlendState<CW_RGBA, BO_Add, BF_One, BF_Source1Color, BO_Add, BF_One, BF_Source1Alpha>::GetRHI());
-		PassDrawRenderState.SetPassUniformBuffer(Scene->UniformBuffers.MobileTranslucentBasePassUniformBuffer);
-	}
-	else
-	{
-		PassDrawRenderState.SetBlendState(TStaticBlendStateWriteMask<CW_RGBA>::GetRHI());
-		PassDrawRenderState.SetPassUniformBuffer(Scene->UniformBuffers.MobileOpaqueBasePassUniformBuffer);
-	} 
-	*/
 
+	// Cached commands are kept while the capture is turned off, the view relevance skips them
 	if ( (!PrimitiveSceneProxy || PrimitiveSceneProxy->ShouldRenderInMainPass())
 		&& ShouldIncludeDomainInMeshPass(Material.GetMaterialDomain())
 		&& PrimitiveSceneProxy->ShouldRenderCustomCapture()
+		&& PrimitiveSceneProxy->GetCustomCaptureChannelMask() != 0
 		)
 	{
-		const FMaterialRenderProxy& DefualtProxy = *UMaterial::GetDefaultMaterial(MD_Surface)->GetRenderProxy();
-		const FMaterial& DefaltMaterial = *DefualtProxy.GetMaterial(Scene->GetFeatureLevel());
-		Process(
-			MeshBatch,
-			BatchElementMask,
-			StaticMeshId,
-			PrimitiveSceneProxy,
-			DefualtProxy,
-			DefaltMaterial
-		);
+		// The override of the component replaces any other material, unless it isn't compiled for the vertex factory.
+		// Like the materials of the mesh batches, it is only drawn when the component reports it in GetUsedMaterials.
+		const FMaterialRenderProxy* CustomCaptureMaterialProxy = AreCustomCaptureMaterialOverridesEnabled() ? PrimitiveSceneProxy->GetCustomCaptureMaterialProxy() : nullptr;
+		if (CustomCaptureMaterialProxy && PrimitiveSceneProxy->VerifyUsedMaterial(CustomCaptureMaterialProxy))
+		{
+			if (TryAddMeshBatch(MeshBatch, BatchElementMask, PrimitiveSceneProxy, StaticMeshId, *CustomCaptureMaterialProxy))
+			{
+				return;
+			}
+		}
+
+		if (MaterialMode != ECustomCaptureMaterialMode::Default
+			&& TryAddMeshBatch(MeshBatch, BatchElementMask, PrimitiveSceneProxy, StaticMeshId, *MeshBatch.MaterialRenderProxy))
+		{
+			return;
+		}
+
+		TryAddMeshBatch(MeshBatch, BatchElementMask, PrimitiveSceneProxy, StaticMeshId, *UMaterial::GetDefaultMaterial(MD_Surface)->GetRenderProxy());
+	}
 
-		/* if use MeshBatch's mateiril
-		Process(
-			MeshBatch,
-			BatchElementMask,
-			StaticMeshId,
-			PrimitiveSceneProxy,
-			MaterialRenderProxy,
-			Material
-		);
-		*/
+}
 
+bool FMyPassProcessor::TryAddMeshBatch(
+	const FMeshBatch& RESTRICT MeshBatch,
+	uint64 BatchElementMask,
+	const FPrimitiveSceneProxy* RESTRICT PrimitiveSceneProxy,
+	int32 StaticMeshId,
+	const FMaterialRenderProxy& InMaterialRenderProxy
+)
+{
+	const FMaterialRenderProxy* FallbackMaterialRenderProxyPtr = nullptr;
+	const FMaterial& Material = InMaterialRenderProxy.GetMaterialWithFallback(Scene->GetFeatureLevel(), FallbackMaterialRenderProxyPtr);
+	const FMaterialRenderProxy& MaterialRenderProxy = FallbackMaterialRenderProxyPtr ? *FallbackMaterialRenderProxyPtr : InMaterialRenderProxy;
+
+	// The capture is the render target of the pass, materials sampling it are replaced by the default material
+	const FMaterialShaderMap* MaterialShaderMap = Material.GetRenderingThreadShaderMap();
+	if (MaterialShaderMap && MaterialShaderMap->UsesSceneTexture(PPI_CustomCapture))
+	{
+		return false;
 	}
 
+	FMeshPassProcessorRenderState DrawRenderState(PassDrawRenderState);
+
+	// the blend mode is part of the material, cached draw commands stay valid
+	const EBlendMode BlendMode = Material.GetBlendMode();
+	DrawRenderState.SetBlendState(GetCustomCaptureBlendState(PrimitiveSceneProxy->GetCustomCaptureChannelMask(), GetCustomCaptureBlend(MaterialMode, BlendMode), bSceneColorAttachment));
+
+	return Process(
+		MeshBatch,
+		BatchElementMask,
+		StaticMeshId,
+		PrimitiveSceneProxy,
+		MaterialRenderProxy,
+		Material,
+		DrawRenderState
+	);
 }
 
-void FMyPassProcessor::Process(
+bool FMyPassProcessor::Process(
 	const FMeshBatch& MeshBatch,
 	uint64 BatchElementMask,
 	int32 StaticMeshId,
 	const FPrimitiveSceneProxy* RESTRICT PrimitiveSceneProxy,
 	const FMaterialRenderProxy& RESTRICT MaterialRenderProxy,
-	const FMaterial& RESTRICT MaterialResource
+	const FMaterial& RESTRICT MaterialResource,
+	const FMeshPassProcessorRenderState& RESTRICT DrawRenderState
 )
 {
 	const FVertexFactory* VertexFactory = MeshBatch.VertexFactory;
@@ -275,19 +1335,99 @@ void FMyPassProcessor::Process(
 		FMyPassPS
 	>MyPassShaders;
 
-	MyPassShaders.VertexShader = MaterialResource.GetShader<FMyPassVS>(VertexFactory->GetType());
-	MyPassShaders.PixelShader = MaterialResource.GetShader<FMyPassPS>(VertexFactory->GetType());
+	// A uniform emissive color needs neither vertex attributes nor interpolants, only positions are fetched
+	const FMaterialShaderMap* MaterialShaderMap = MaterialResource.GetRenderingThreadShaderMap();
+	bool bPositionOnly = IsCustomCapturePositionOnlyEnabled()
+		&& MaterialShaderMap
+		&& MaterialShaderMap->HasUniformEmissiveColor()
+		&& !MaterialShaderMap->ModifiesMeshPosition()
+		&& MaterialResource.GetBlendMode() == BLEND_Opaque
+		&& VertexFactory->SupportsPositionOnlyStream();
+
+	if (bPositionOnly)
+	{
+		FMaterialShaderTypes PositionOnlyShaderTypes;
+		PositionOnlyShaderTypes.AddShaderType<FMyPassPositionOnlyVS>();
+		if (MaterialMode != ECustomCaptureMaterialMode::Default)
+		{
+			if (bSceneColorAttachment)
+			{
+				PositionOnlyShaderTypes.AddShaderType<FMyPassPositionOnlyMeshMaterialAttachmentPS>();
+			}
+			else
+			{
+				PositionOnlyShaderTypes.AddShaderType<FMyPassPositionOnlyMeshMaterialPS>();
+			}
+		}
+		else if (bSceneColorAttachment)
+		{
+			PositionOnlyShaderTypes.AddShaderType<FMyPassPositionOnlyAttachmentPS>();
+		}
+		else
+		{
+			PositionOnlyShaderTypes.AddShaderType<FMyPassPositionOnlyPS>();
+		}
+
+		FMaterialShaders PositionOnlyShaders;
+		bPositionOnly = MaterialResource.TryGetShaders(PositionOnlyShaderTypes, VertexFactory->GetType(), PositionOnlyShaders);
+		if (bPositionOnly)
+		{
+			PositionOnlyShaders.TryGetVertexShader(MyPassShaders.VertexShader);
+			PositionOnlyShaders.TryGetPixelShader(MyPassShaders.PixelShader);
+		}
+	}
+
+	if (!bPositionOnly)
+	{
+		FMaterialShaderTypes ShaderTypes;
+		ShaderTypes.AddShaderType<FMyPassVS>();
+		if (MaterialMode != ECustomCaptureMaterialMode::Default)
+		{
+			if (bSceneColorAttachment)
+			{
+				ShaderTypes.AddShaderType<FMyPassMeshMaterialAttachmentPS>();
+			}
+			else
+			{
+				ShaderTypes.AddShaderType<FMyPassMeshMaterialPS>();
+			}
+		}
+		else if (bSceneColorAttachment)
+		{
+			ShaderTypes.AddShaderType<FMyPassAttachmentPS>();
+		}
+		else
+		{
+			ShaderTypes.AddShaderType<FMyPassPS>();
+		}
+
+		// Override materials may not be compiled for the vertex factory of the mesh
+		FMaterialShaders Shaders;
+		if (!MaterialResource.TryGetShaders(ShaderTypes, VertexFactory->GetType(), Shaders))
+		{
+			return false;
+		}
+
+		Shaders.TryGetVertexShader(MyPassShaders.VertexShader);
+		Shaders.TryGetPixelShader(MyPassShaders.PixelShader);
+	}
 	
 	const FMeshDrawingPolicyOverrideSettings OverrideSettings = ComputeMeshOverrideSettings(MeshBatch);
 	const ERasterizerFillMode MeshFillMode = ComputeMeshFillMode(MeshBatch, MaterialResource, OverrideSettings);
 	const ERasterizerCullMode MeshCullMode = ComputeMeshCullMode(MeshBatch, MaterialResource, OverrideSettings);
 
-	FPlannarShadowShaderElementData ShaderElementData;
+	FMeshMaterialShaderElementData ShaderElementData;
 	ShaderElementData.InitializeMeshMaterialData(ViewIfDynamicMeshCommand, PrimitiveSceneProxy, MeshBatch, StaticMeshId, true);
-	float height = PrimitiveSceneProxy->GetPlannarShadowBaseHeight();
-	ShaderElementData.ShadowBaseHeight = height;
 
-	const FMeshDrawCommandSortKey SortKey = CalculateMeshStaticSortKey(MyPassShaders.VertexShader, MyPassShaders.PixelShader);
+	const ECustomCaptureBlend Blend = GetCustomCaptureBlend(MaterialMode, MaterialResource.GetBlendMode());
+	const FMeshDrawCommandSortKey SortKey = MaterialMode == ECustomCaptureMaterialMode::MeshTranslucent
+		? CalculateCustomCaptureTranslucentSortKey(ViewIfDynamicMeshCommand, PrimitiveSceneProxy, MeshBatch, Blend)
+		: CalculateCustomCaptureSortKey(
+			MyPassShaders.VertexShader,
+			MyPassShaders.PixelShader,
+			PrimitiveSceneProxy->GetCustomCaptureChannelMask(),
+			Blend,
+			VertexFactory);
 
 	BuildMeshDrawCommands(
 		MeshBatch,
@@ -295,15 +1435,16 @@ void FMyPassProcessor::Process(
 		PrimitiveSceneProxy,
 		MaterialRenderProxy,
 		MaterialResource,
-		PassDrawRenderState,
+		DrawRenderState,
 		MyPassShaders,
 		MeshFillMode,
 		MeshCullMode,
 		SortKey,
-		EMeshPassFeatures::Default,
+		bPositionOnly ? EMeshPassFeatures::PositionOnly : EMeshPassFeatures::Default,
 		ShaderElementData
 	);
 
+	return true;
 }
 
 FMeshPassProcessor* CreateMyPassProcessor(
@@ -326,4 +1467,51 @@ FRegisterPassProcessorCreateFunction RegisterMyPass(
 	EShadingPath::Mobile,
 	EMeshPass::CustomCapturePass,
 	EMeshPassFlags::CachedMeshCommands | EMeshPassFlags::MainView
-);
\ No newline at end of file
+);
+
+void CacheCustomCaptureMeshDrawCommands(FScene* Scene, const TSet<FPrimitiveSceneInfo*>& SceneInfos)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_CacheCustomCaptureMeshDrawCommands);
+
+	const EMeshPass::Type PassType = EMeshPass::CustomCapturePass;
+	FCachedMeshDrawCommandInfo CommandInfo(PassType);
+	FCachedPassMeshDrawListContext CachedPassMeshDrawListContext(CommandInfo, Scene->CachedMeshDrawCommandLock[PassType], Scene->CachedDrawLists[PassType], Scene->CachedMeshDrawCommandStateBuckets[PassType], *Scene);
+	FMyPassProcessor PassMeshProcessor(Scene, nullptr, true, Scene->bEarlyZPassMovable, &CachedPassMeshDrawListContext);
+
+	for (FPrimitiveSceneInfo* PrimitiveSceneInfo : SceneInfos)
+	{
+		// Turned off again before the update
+		if (!PrimitiveSceneInfo->Proxy->ShouldRenderCustomCapture())
+		{
+			continue;
+		}
+
+		for (int32 MeshIndex = 0; MeshIndex < PrimitiveSceneInfo->StaticMeshes.Num(); MeshIndex++)
+		{
+			FStaticMeshBatchRelevance& MeshRelevance = PrimitiveSceneInfo->StaticMeshRelevances[MeshIndex];
+
+			// Meshes cached while the primitive was captured before still have their command
+			if (MeshRelevance.CommandInfosMask.Get(PassType) || !MeshRelevance.bSupportsCachingMeshDrawCommands)
+			{
+				continue;
+			}
+
+			const uint64 BatchElementMask = ~0ull;
+			PassMeshProcessor.AddMeshBatch(PrimitiveSceneInfo->StaticMeshes[MeshIndex], BatchElementMask, PrimitiveSceneInfo->Proxy);
+
+			if (CommandInfo.CommandIndex != INDEX_NONE || CommandInfo.StateBucketId != INDEX_NONE)
+			{
+				// The command infos of a mesh are ordered by pass, the ones of the following meshes move by one
+				MeshRelevance.CommandInfosMask.Set(PassType);
+				PrimitiveSceneInfo->StaticMeshCommandInfos.Insert(CommandInfo, MeshRelevance.GetStaticMeshCommandInfoIndex(PassType));
+
+				for (int32 NextMeshIndex = MeshIndex + 1; NextMeshIndex < PrimitiveSceneInfo->StaticMeshRelevances.Num(); NextMeshIndex++)
+				{
+					PrimitiveSceneInfo->StaticMeshRelevances[NextMeshIndex].CommandInfosBase++;
+				}
+
+				CommandInfo = FCachedMeshDrawCommandInfo(PassType);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -2,16 +2,57 @@
 
 #include "MeshPassProcessor.h"
 
-BEGIN_GLOBAL_SHADER_PARAMETER_STRUCT(FMyPassUniformParameters, )
-END_GLOBAL_SHADER_PARAMETER_STRUCT()
-
-typedef TUniformBufferRef<FMyPassUniformParameters> FMyPassUniformBufferRef;
-
+class FPrimitiveSceneInfo;
 class FPrimitiveSceneProxy;
 class FScene;
 class FStaticMeshBatch;
 class FViewInfo;
 
+/** Which material the capture primitives are drawn with, see r.Mobile.CustomCapture.MaterialMode. */
+enum class ECustomCaptureMaterialMode : uint8
+{
+	/** Default material, the red emissive channel is written to every capture channel of the primitive */
+	Default,
+	/** Mesh material, emissive color and opacity overwrite the capture */
+	Mesh,
+	/** Mesh material, emissive color and opacity are added to the capture */
+	MeshAdditive,
+	/** Mesh material, blended into the capture following the blend mode of the material */
+	MeshTranslucent,
+};
+
+extern ECustomCaptureMaterialMode GetCustomCaptureMaterialMode();
+
+/** Returns false if the project doesn't use the capture and none of its shaders are compiled, see r.Mobile.CustomCapture. */
+extern bool IsCustomCaptureEnabled();
+
+/** Returns true if the capture is drawn to the second color attachment, see r.Mobile.CustomCapture.SceneColorAttachment. */
+extern bool IsCustomCaptureSceneColorAttachmentEnabled();
+
+/** Returns true if the capture is depth tested against the scene depth, see r.Mobile.CustomCapture.DepthTest. */
+extern bool IsCustomCaptureDepthTestEnabled();
+
+/**
+ * Returns true if the capture pass of the scene binds the scene depth and its draws are depth tested this frame.
+ * Depends on runtime settings, so the depth tested draws are built every frame instead of cached.
+ */
+extern bool IsCustomCaptureDepthTested(const FScene* Scene);
+
+/** Returns true if the view has capture primitives and a relevant material or post-process material samples PPI_CustomCapture. */
+extern bool UsesCustomCaptureLookup(const FScene* Scene, const FViewInfo& View);
+
+/** Returns the pixel rect of the view covered by the projected bounds, the whole view rect when the bounds cross the near plane. */
+extern FIntRect ComputeCustomCaptureScreenRect(const FViewInfo& View, const FBoxSphereBounds& Bounds);
+
+/** Sorts the blended capture draws of a view back to front, like the translucent passes the cached commands only get their distance per view. */
+extern void UpdateCustomCaptureTranslucentSortKeys(const FScene* Scene, const FViewInfo& View, FMeshCommandOneFrameArray& VisibleMeshDrawCommands);
+
+/** Counts the capture draws of a view before and after dynamic instancing merges them, see stat SceneRendering. */
+extern void UpdateCustomCaptureDrawStats(const FViewInfo& View, const FMeshCommandOneFrameArray& VisibleMeshDrawCommands, int32 NumDynamicMeshElements);
+
+/** Caches the CustomCapturePass commands of primitives captured after their static meshes were cached, the other passes keep their commands. */
+extern void CacheCustomCaptureMeshDrawCommands(FScene* Scene, const TSet<FPrimitiveSceneInfo*>& SceneInfos);
+
 class FMyPassProcessor : public FMeshPassProcessor
 {
 
@@ -34,18 +75,30 @@ public:
 
 private:
 
-    void Process(
+    bool TryAddMeshBatch(
+        const FMeshBatch& RESTRICT MeshBatch,
+        uint64 BatchElementMask,
+        const FPrimitiveSceneProxy* RESTRICT PrimitiveSceneProxy,
+        int32 StaticMeshId,
+        const FMaterialRenderProxy& InMaterialRenderProxy
+    );
+
+    bool Process(
         const FMeshBatch& MeshBatch,
         uint64 BatchElementMask,
         int32 StaticMeshId,
         const FPrimitiveSceneProxy* RESTRICT PrimitiveSceneProxy,
         const FMaterialRenderProxy& RESTRICT MaterialRenderProxy,
-        const FMaterial& RESTRICT MaterialResource
+        const FMaterial& RESTRICT MaterialResource,
+        const FMeshPassProcessorRenderState& RESTRICT DrawRenderState
     );
 
     FMeshPassProcessorRenderState PassDrawRenderState;
 
     const bool bRespectUseAsOccluderFlag;
     const bool bEarlyZPassMoveable;
+    const bool bSceneColorAttachment;
+    const bool bDepthTest;
+    const ECustomCaptureMaterialMode MaterialMode;
 
 };
\ No newline at end of file
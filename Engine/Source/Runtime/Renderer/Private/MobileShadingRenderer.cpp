@@ -56,6 +56,7 @@
 #include "PlanarReflectionSceneProxy.h"
 #include "SceneOcclusion.h"
 #include "VariableRateShadingImageManager.h"
+#include "CustomCapturePass.h"
 
 uint32 GetShadowQuality();
 
@@ -202,6 +203,9 @@ FMobileSceneRenderer::FMobileSceneRenderer(const FSceneViewFamily* InViewFamily,
 	bSubmitOffscreenRendering = false;
 	bModulatedShadowsInUse = false;
 	bShouldRenderCustomDepth = false;
+	bShouldRenderCustomCapture = false;
+	bRenderCustomCaptureInSceneColorPass = false;
+	bRenderCustomCaptureAfterFX = false;
 	bRequiresPixelProjectedPlanarRelfectionPass = false;
 	bRequiresAmbientOcclusionPass = false;
 	bRequiresDistanceFieldShadowingPass = false;
@@ -472,6 +476,27 @@ void FMobileSceneRenderer::InitViews(FRHICommandListImmediate& RHICmdList)
 		}
 	}
 
+	// Custom capture pass, bCustomCaptureValid has been resolved in ComputeViewVisibility
+	// GPU particles reuse the sorted and culled buffers of the main pass, the capture waits for the FX system to complete them.
+	// Materials drawn before then sample the capture of the previous frame.
+	bool bCustomCaptureHasGPUParticles = false;
+	bool bUsesCustomCaptureInMaterials = false;
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+	{
+		const FViewInfo& View = Views[ViewIndex];
+		bShouldRenderCustomCapture |= View.bCustomCaptureValid;
+		if (View.bCustomCaptureValid)
+		{
+			bCustomCaptureHasGPUParticles |= View.bHasCustomCaptureGPUParticles;
+			bUsesCustomCaptureInMaterials |= View.bUsesCustomCaptureInMaterials;
+		}
+	}
+	bRenderCustomCaptureAfterFX = bCustomCaptureHasGPUParticles && FXSystem && ViewFamily.EngineShowFlags.Particles;
+	if (bRenderCustomCaptureAfterFX && bUsesCustomCaptureInMaterials)
+	{
+		UseCustomCaptureHistoryUntilRendered(RHICmdList);
+	}
+
 #if PLATFORM_HOLOLENS
 	// Check if any material renders depth to translucent materials.
 	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
@@ -766,14 +791,39 @@ void FMobileSceneRenderer::Render(FRHICommandListImmediate& RHICmdList)
 		ViewList.Add(&Views[ViewIndex]);
 	}
 
-	// Custom depth
-	// bShouldRenderCustomDepth has been initialized in InitViews on mobile platform
-	if (bShouldRenderCustomDepth)
+	// A depth tested capture waits for the full depth prepass
+	const bool bRenderCustomCaptureAfterPrepass = bShouldRenderCustomCapture && !bRenderCustomCaptureAfterFX && IsCustomCaptureDepthTested(Scene);
+
+	// The skin cache output is read by every pass from here on, starting with the capture of skeletal meshes
+	RunGPUSkinCacheTransition(RHICmdList, Scene, EGPUSkinCacheTransition::Renderer);
+
+	// Custom depth and custom capture
+	// bShouldRenderCustomDepth and bShouldRenderCustomCapture have been initialized in InitViews on mobile platform
+	const bool bRenderCustomCaptureEarly = bShouldRenderCustomCapture && !bRenderCustomCaptureAfterPrepass && !bRenderCustomCaptureAfterFX;
+	if (bShouldRenderCustomDepth || bRenderCustomCaptureEarly)
 	{
 		FRDGBuilder GraphBuilder(RHICmdList);
-		FSceneTextureShaderParameters SceneTextures = CreateSceneTextureShaderParameters(GraphBuilder, Views[0].GetFeatureLevel(), ESceneTextureSetupMode::None);
-		RenderCustomDepthPass(GraphBuilder, SceneTextures);
+		if (bShouldRenderCustomDepth)
+		{
+			FSceneTextureShaderParameters SceneTextures = CreateSceneTextureShaderParameters(GraphBuilder, Views[0].GetFeatureLevel(), ESceneTextureSetupMode::None);
+			RenderCustomDepthPass(GraphBuilder, SceneTextures);
+		}
+		if (bRenderCustomCaptureEarly)
+		{
+			RenderCustomCapturePass(GraphBuilder, ViewList);
+		}
 		GraphBuilder.Execute();
+
+		if (bRenderCustomCaptureEarly)
+		{
+			UpdateBasePassUniformBuffersForCustomCapture(RHICmdList);
+		}
+	}
+
+	if (!bShouldRenderCustomCapture)
+	{
+		// Nothing samples the capture this frame, the kept capture is released as well
+		SceneContext.CustomCapture.SafeRelease();
 	}
 
 	if (bIsFullPrepassEnabled)
@@ -799,6 +849,15 @@ void FMobileSceneRenderer::Render(FRHICommandListImmediate& RHICmdList)
 
 		RHICmdList.EndRenderPass();
 
+		if (bRenderCustomCaptureAfterPrepass)
+		{
+			FRDGBuilder GraphBuilder(RHICmdList);
+			RenderCustomCapturePass(GraphBuilder, ViewList);
+			GraphBuilder.Execute();
+
+			UpdateBasePassUniformBuffersForCustomCapture(RHICmdList);
+		}
+
 		if (bRequiresDistanceFieldShadowingPass)
 		{
 			CSV_SCOPED_TIMING_STAT_EXCLUSIVE(RenderSDFShadowing);
@@ -874,6 +933,11 @@ void FMobileSceneRenderer::Render(FRHICommandListImmediate& RHICmdList)
 				}
 			});
 		}
+
+		if (bRenderCustomCaptureAfterFX)
+		{
+			RenderCustomCapturePass(GraphBuilder, ViewList);
+		}
 		GraphBuilder.Execute();
 	}
 
@@ -952,6 +1016,7 @@ void FMobileSceneRenderer::Render(FRHICommandListImmediate& RHICmdList)
 							SetupMode |= EMobileSceneTextureSetupMode::SceneVelocity;
 						}
 
+						SceneContext.SetCustomCaptureView(ViewIndex);
 						MobileSceneTexturesPerView[ViewIndex] = CreateMobileSceneTextureUniformBuffer(GraphBuilder, SetupMode);
 					}
 				};
@@ -979,6 +1044,9 @@ void FMobileSceneRenderer::Render(FRHICommandListImmediate& RHICmdList)
 	{
 		SceneContext.SceneVelocity.SafeRelease();
 	}
+
+	// Every pass reading the capture has been set up, the post-processing graph holds its own reference
+	SceneContext.ReleaseTransientCustomCapture();
 	
 	if (ViewFamily.bLateLatchingEnabled)
 	{
@@ -1097,8 +1165,21 @@ FRHITexture* FMobileSceneRenderer::RenderForward(FRHICommandListImmediate& RHICm
 	//if the scenecolor isn't multiview but the app is, need to render as a single-view multiview due to shaders
 	SceneColorRenderPassInfo.MultiViewCount = View.bIsMobileMultiViewEnabled ? 2 : (bIsMultiViewApplication ? 1 : 0);
 
-	// Render CustomCapture Pass before SceneColorRendering
-	RenderCustomCapturePass(RHICmdList, ViewList);
+	// The custom capture can be the second attachment of this pass, saving a render pass of its own.
+	// The attachment is bound whenever the capture could be drawn here, so that the render target layout of the pass
+	// and of all of its PSOs doesn't depend on the capture being drawn this frame. Otherwise it is a memoryless stand-in.
+	if (CanRenderCustomCaptureInSceneColorPass())
+	{
+		FRHITexture* CustomCaptureTexture = bRenderCustomCaptureInSceneColorPass
+			? SceneContext.CustomCapture->GetRenderTargetItem().TargetableTexture
+			: SceneContext.GetCustomCaptureAttachmentDummy(RHICmdList);
+		SceneColorRenderPassInfo.ColorRenderTargets[1].RenderTarget = CustomCaptureTexture;
+		SceneColorRenderPassInfo.ColorRenderTargets[1].ResolveTarget = nullptr;
+		SceneColorRenderPassInfo.ColorRenderTargets[1].ArraySlice = -1;
+		SceneColorRenderPassInfo.ColorRenderTargets[1].MipIndex = 0;
+		SceneColorRenderPassInfo.ColorRenderTargets[1].Action = bRenderCustomCaptureInSceneColorPass ? ERenderTargetActions::DontLoad_Store : ERenderTargetActions::DontLoad_DontStore;
+		RHICmdList.Transition(FRHITransitionInfo(CustomCaptureTexture, ERHIAccess::Unknown, ERHIAccess::RTV));
+	}
 
 	RHICmdList.BeginRenderPass(SceneColorRenderPassInfo, TEXT("SceneColorRendering"));
 	
@@ -1159,6 +1240,12 @@ FRHITexture* FMobileSceneRenderer::RenderForward(FRHICommandListImmediate& RHICm
 	// Split if we need to render pixel projected reflection
 	if (bRequiresMultiPass || bRequiresPixelProjectedPlanarRelfectionPass)
 	{
+		// The translucency render pass doesn't have the capture attachment
+		if (bRenderCustomCaptureInSceneColorPass)
+		{
+			RenderCustomCaptureInSceneColorPass(RHICmdList, ViewList);
+		}
+
 		RHICmdList.EndRenderPass();
 	}
 	   
@@ -1277,9 +1364,20 @@ FRHITexture* FMobileSceneRenderer::RenderForward(FRHICommandListImmediate& RHICm
 		PreTonemapMSAA(RHICmdList);
 	}
 
+	// Drawn last, so that nothing else in the pass writes to the capture attachment afterwards
+	if (bRenderCustomCaptureInSceneColorPass && !(bRequiresMultiPass || bRequiresPixelProjectedPlanarRelfectionPass))
+	{
+		RenderCustomCaptureInSceneColorPass(RHICmdList, ViewList);
+	}
+
 	// End of scene color rendering
 	RHICmdList.EndRenderPass();
 
+	if (bRenderCustomCaptureInSceneColorPass)
+	{
+		RHICmdList.Transition(FRHITransitionInfo(SceneContext.CustomCapture->GetRenderTargetItem().TargetableTexture, ERHIAccess::RTV, ERHIAccess::SRVGraphics));
+	}
+
 	return SceneColorResolve ? SceneColorResolve : SceneColor;
 }
 
@@ -1628,6 +1726,9 @@ void FMobileSceneRenderer::ConditionalResolveSceneDepth(FRHICommandListImmediate
 
 void FMobileSceneRenderer::UpdateOpaqueBasePassUniformBuffer(FRHICommandListImmediate& RHICmdList, const FViewInfo& View)
 {
+	// The capture lookup of each view is limited to its own capture rect
+	FSceneRenderTargets::Get(RHICmdList).SetCustomCaptureView(Views.IndexOfByPredicate([&View](const FViewInfo& Other) { return &Other == &View; }));
+
 	FMobileBasePassUniformParameters Parameters;
 	SetupMobileBasePassUniformParameters(RHICmdList, View, false, false, Parameters);
 	Scene->UniformBuffers.MobileOpaqueBasePassUniformBuffer.UpdateUniformBufferImmediate(Parameters);
@@ -1637,11 +1738,24 @@ void FMobileSceneRenderer::UpdateOpaqueBasePassUniformBuffer(FRHICommandListImme
 
 void FMobileSceneRenderer::UpdateTranslucentBasePassUniformBuffer(FRHICommandListImmediate& RHICmdList, const FViewInfo& View)
 {
+	FSceneRenderTargets::Get(RHICmdList).SetCustomCaptureView(Views.IndexOfByPredicate([&View](const FViewInfo& Other) { return &Other == &View; }));
+
 	FMobileBasePassUniformParameters Parameters;
 	SetupMobileBasePassUniformParameters(RHICmdList, View, true, false, Parameters);
 	Scene->UniformBuffers.MobileTranslucentBasePassUniformBuffer.UpdateUniformBufferImmediate(Parameters);
 }
 
+void FMobileSceneRenderer::UpdateBasePassUniformBuffersForCustomCapture(FRHICommandListImmediate& RHICmdList)
+{
+	// A single view has its base pass uniform buffers set up in InitViews, before the capture and its rect of this frame.
+	// Multiple views update them before rendering each view.
+	if (Views.Num() == 1)
+	{
+		UpdateOpaqueBasePassUniformBuffer(RHICmdList, Views[0]);
+		UpdateTranslucentBasePassUniformBuffer(RHICmdList, Views[0]);
+	}
+}
+
 void FMobileSceneRenderer::UpdateDirectionalLightUniformBuffers(FRHICommandListImmediate& RHICmdList, const FViewInfo& View)
 {
 	bool bDynamicShadows = ViewFamily.EngineShowFlags.DynamicShadows;
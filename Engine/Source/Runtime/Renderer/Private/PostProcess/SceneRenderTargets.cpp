@@ -31,6 +31,7 @@
 #include "VisualizeTexture.h"
 #include "GpuDebugRendering.h"
 #include "IHeadMountedDisplayModule.h"
+#include "CustomCapturePass.h"
 
 static TAutoConsoleVariable<int32> CVarRSMResolution(
 	TEXT("r.LPV.RSMResolution"),
@@ -95,6 +96,24 @@ static TAutoConsoleVariable<int32> CVarMobileCustomDepthDownSample(
 	ECVF_RenderThreadSafe
 );
 
+static TAutoConsoleVariable<int32> CVarMobileCustomCaptureFormat(
+	TEXT("r.Mobile.CustomCapture.Format"),
+	0,
+	TEXT("Precision of the CustomCapture target, which always holds every capture channel in use \n ")
+	TEXT("0: Auto, one 16 bit float channel per capture channel in use (default)\n ")
+	TEXT("1: 8 bit unorm, for captures whose values stay in [0, 1], e.g. IDs written as ID / 255. Mesh material captures stay 16 bit float \n ")
+	TEXT("2: R11G11B10 float, for captures whose values are positive. Captures using the alpha channel stay 16 bit float \n ")
+	TEXT("3: RGBA16 float \n "),
+	ECVF_RenderThreadSafe
+);
+
+static TAutoConsoleVariable<float> CVarMobileCustomCaptureResolutionScale(
+	TEXT("r.Mobile.CustomCapture.ResolutionScale"),
+	1.0f,
+	TEXT("Resolution of the CustomCapture target as a fraction of the scene buffer, in (0, 1] (default 1)"),
+	ECVF_RenderThreadSafe
+);
+
 static TAutoConsoleVariable<int32> CVarMSAACount(
 	TEXT("r.MSAACount"),
 	4,
@@ -274,6 +293,17 @@ FSceneRenderTargets::FSceneRenderTargets(const FViewInfo& View, const FSceneRend
 	, EditorPrimitivesDepth(GRenderTargetPool.MakeSnapshot(SnapshotSource.EditorPrimitivesDepth))
 	, bScreenSpaceAOIsValid(SnapshotSource.bScreenSpaceAOIsValid)
 	, bCustomDepthIsValid(SnapshotSource.bCustomDepthIsValid)
+	, CustomCaptureUVScale(SnapshotSource.CustomCaptureUVScale)
+	, CustomCaptureUVRect(SnapshotSource.CustomCaptureUVRect)
+	, CustomCaptureViewUVRects(SnapshotSource.CustomCaptureViewUVRects)
+	, CustomCaptureClipToCaptureClip(SnapshotSource.CustomCaptureClipToCaptureClip)
+	, bCustomCaptureReproject(SnapshotSource.bCustomCaptureReproject)
+	, CustomCaptureViewKey(SnapshotSource.CustomCaptureViewKey)
+	, CustomCaptureFrameNumber(SnapshotSource.CustomCaptureFrameNumber)
+	, CustomCaptureRotatedView(SnapshotSource.CustomCaptureRotatedView)
+	, CustomCaptureViewProjectionMatrix(SnapshotSource.CustomCaptureViewProjectionMatrix)
+	, bCustomCaptureIsTransient(SnapshotSource.bCustomCaptureIsTransient)
+	, bCustomCaptureAttached(SnapshotSource.bCustomCaptureAttached)
 	, GBufferRefCount(SnapshotSource.GBufferRefCount)
 	, ThisFrameNumber(SnapshotSource.ThisFrameNumber)
 	, CurrentDesiredSizeIndex(SnapshotSource.CurrentDesiredSizeIndex)
@@ -1985,6 +2015,7 @@ void FSceneRenderTargets::ReleaseAllTargets()
 	MobileCustomStencil.SafeRelease();
 	CustomStencilSRV.SafeRelease();
 	CustomCapture.SafeRelease();
+	CustomCaptureAttachmentDummy.SafeRelease();
 	VirtualTextureFeedback.SafeRelease();
 	VirtualTextureFeedbackUAV.SafeRelease();
 
@@ -2087,31 +2118,170 @@ const FUnorderedAccessViewRHIRef& FSceneRenderTargets::GetSceneColorTextureUAV()
 	return (const FUnorderedAccessViewRHIRef&)GetSceneColor()->GetRenderTargetItem().UAV;
 }
 
-FCustomCaptureTextures FSceneRenderTargets::RequestCustomCapture(FRHICommandListImmediate& RHICmdList, bool bPrimitives)
+/** Packs one capture layer per channel in the smallest format holding the highest channel in use, at the precision picked by r.Mobile.CustomCapture.Format. */
+static EPixelFormat GetCustomCaptureFormat(uint8 ChannelMask)
 {
-	FCustomCaptureTextures CustomCaptureTextures{};
+	const int32 Precision = CVarMobileCustomCaptureFormat.GetValueOnRenderThread();
 
-	const bool bMobilePath = (CurrentFeatureLevel <= ERHIFeatureLevel::ES3_1);
-	const int32 DownsampleFactor = bMobilePath && CVarMobileCustomDepthDownSample.GetValueOnRenderThread() > 0 ? 2 : 1;
+	// The mesh material modes write the emissive color of the material, it isn't bounded
+	if (Precision == 1 && GetCustomCaptureMaterialMode() == ECustomCaptureMaterialMode::Default)
+	{
+		return ChannelMask <= 0x1 ? PF_G8 : (ChannelMask <= 0x3 ? PF_R8G8 : PF_B8G8R8A8);
+	}
+	else if (Precision == 2 && ChannelMask <= 0x7)
+	{
+		return PF_FloatR11G11B10;
+	}
+	else if (Precision == 3)
+	{
+		return PF_FloatRGBA;
+	}
+
+	if (ChannelMask <= 0x1)
+	{
+		return PF_R16F;
+	}
+	else if (ChannelMask <= 0x3)
+	{
+		return PF_G16R16F;
+	}
+	return PF_FloatRGBA;
+}
+
+/** Scale of the sampled capture channels, 0 for the channels missing from the format so that they read as black like the rest of the lookup. */
+static FVector4 GetCustomCaptureChannelScale(EPixelFormat Format)
+{
+	const int32 NumComponents = Format != PF_Unknown ? GPixelFormats[Format].NumComponents : 0;
+	return FVector4(
+		NumComponents > 0 ? 255.0f : 0.0f,
+		NumComponents > 1 ? 255.0f : 0.0f,
+		NumComponents > 2 ? 255.0f : 0.0f,
+		NumComponents > 3 ? 255.0f : 0.0f);
+}
+
+/** Black Texture2DArray bound to the mobile scene textures in place of a multi-view CustomCapture. */
+class FCustomCaptureBlackArrayDummy : public FRenderResource
+{
+public:
+	const TRefCountPtr<IPooledRenderTarget>& GetTexture()
+	{
+		// GBlackArrayTexture may be initialized after this resource, wrap it on first use
+		if (!Texture)
+		{
+			Texture = CreateRenderTarget(GBlackArrayTexture->TextureRHI, TEXT("CustomCaptureBlackArrayDummy"));
+		}
+		return Texture;
+	}
+
+	virtual void ReleaseRHI() override
+	{
+		Texture.SafeRelease();
+	}
+
+private:
+	TRefCountPtr<IPooledRenderTarget> Texture;
+};
+
+static TGlobalResource<FCustomCaptureBlackArrayDummy> GCustomCaptureBlackArrayDummy;
+
+FRDGTextureDesc FSceneRenderTargets::GetCustomCaptureDesc(uint8 ChannelMask, uint32 MultiViewCount) const
+{
+	// Independent of r.Mobile.CustomDepthDownSample, the capture has its own resolution
+	const float ResolutionScale = FMath::Clamp(CVarMobileCustomCaptureResolutionScale.GetValueOnRenderThread(), 0.01f, 1.0f);
+	const FIntPoint CustomCaptureBufferSize(
+		FMath::Max(FMath::CeilToInt(BufferSize.X * ResolutionScale), 1),
+		FMath::Max(FMath::CeilToInt(BufferSize.Y * ResolutionScale), 1));
+
+	// The set of channels in use can change the format from frame to frame
+	const EPixelFormat CustomCaptureFormat = GetCustomCaptureFormat(ChannelMask);
+	// Multi-view renders every eye into its own slice, a multi-view application always needs an array target
+	return MultiViewCount > 0
+		? FRDGTextureDesc::Create2DArray(CustomCaptureBufferSize, CustomCaptureFormat, FClearValueBinding::Black, TexCreate_RenderTargetable | TexCreate_ShaderResource, MultiViewCount)
+		: FRDGTextureDesc::Create2D(CustomCaptureBufferSize, CustomCaptureFormat, FClearValueBinding::Black, TexCreate_RenderTargetable | TexCreate_ShaderResource);
+}
+
+bool FSceneRenderTargets::CanReuseCustomCapture(uint8 ChannelMask, uint32 MultiViewCount) const
+{
+	if (!CustomCapture)
+	{
+		return false;
+	}
+
+	const FRDGTextureDesc CustomCaptureDesc = GetCustomCaptureDesc(ChannelMask, MultiViewCount);
+	const FPooledRenderTargetDesc& PooledDesc = CustomCapture->GetDesc();
+	return PooledDesc.Extent == CustomCaptureDesc.Extent
+		&& PooledDesc.Format == CustomCaptureDesc.Format
+		&& PooledDesc.bIsArray == CustomCaptureDesc.IsTextureArray()
+		&& (!PooledDesc.bIsArray || PooledDesc.ArraySize == CustomCaptureDesc.ArraySize);
+}
+
+FCustomCaptureTextures FSceneRenderTargets::RequestCustomCapture(FRDGBuilder& GraphBuilder, bool bPrimitives, uint8 ChannelMask, bool bKeepHistory, bool bExternal, uint32 MultiViewCount)
+{
+	FCustomCaptureTextures CustomCaptureTextures{};
 
 	if (bPrimitives)
 	{
-		const FIntPoint CustomDepthBufferSize = FIntPoint::DivideAndRoundUp(BufferSize, DownsampleFactor);
+		const FRDGTextureDesc CustomCaptureDesc = GetCustomCaptureDesc(ChannelMask, MultiViewCount);
+		const FIntPoint CustomCaptureBufferSize = CustomCaptureDesc.Extent;
+		const float ResolutionScale = FMath::Clamp(CVarMobileCustomCaptureResolutionScale.GetValueOnRenderThread(), 0.01f, 1.0f);
 
-		if (!CustomCapture)
+		// The capture is drawn with an exact fractional viewport, compensate for the rounded up target size in the lookup
+		CustomCaptureUVScale = FVector2D(
+			BufferSize.X * ResolutionScale / CustomCaptureBufferSize.X,
+			BufferSize.Y * ResolutionScale / CustomCaptureBufferSize.Y);
+		CustomCaptureTextures.ResolutionScale = ResolutionScale;
+
+		if (bKeepHistory || bExternal)
+		{
+			// The capture outlives the graph, keep the pooled target while its desc still matches
+			if (CanReuseCustomCapture(ChannelMask, MultiViewCount))
+			{
+				CustomCaptureTextures.CustomColor = GraphBuilder.RegisterExternalTexture(CustomCapture);
+				CustomCaptureTextures.bHistoryValid = true;
+			}
+			else
+			{
+				CustomCaptureTextures.CustomColor = GraphBuilder.CreateTexture(CustomCaptureDesc, TEXT("CustomCapture"));
+				ConvertToExternalTexture(GraphBuilder, CustomCaptureTextures.CustomColor, CustomCapture);
+			}
+		}
+		else
 		{
-			FRHIResourceCreateInfo CreateInfo(TEXT("CustomCaptureTexture"));
-			FPooledRenderTargetDesc CustomCaptureRTDesc(FPooledRenderTargetDesc::Create2DDesc(CustomDepthBufferSize, PF_R16F, FClearValueBinding::Black, TexCreate_ShaderResource, TexCreate_RenderTargetable, false));
-			GRenderTargetPool.FindFreeElement(RHICmdList, CustomCaptureRTDesc, CustomCapture, TEXT("CustomCaptureTexture"));
+			// Not kept for later frames. The graph takes a pooled target for it, there is no memory aliasing between graph textures.
+			// The extraction lets the passes outside of the graph read it, it also keeps the graph from culling the capture pass.
+			// ReleaseTransientCustomCapture hands the pooled target back once the last of these passes has been set up.
+			CustomCaptureTextures.CustomColor = GraphBuilder.CreateTexture(CustomCaptureDesc, TEXT("CustomCapture"));
+			GraphBuilder.QueueTextureExtraction(CustomCaptureTextures.CustomColor, &CustomCapture);
 		}
-		
-		CustomCaptureTextures.CustomColor = CustomCapture->GetTargetableRHI();
-		
+	}
+	else
+	{
+		// Nothing samples the capture this frame, hand the target back to the pool so the lookup falls back to black.
+		CustomCapture.SafeRelease();
 	}
 
+	bCustomCaptureIsTransient = bPrimitives && !bKeepHistory;
+
 	return CustomCaptureTextures;
 }
 
+void FSceneRenderTargets::ReleaseTransientCustomCapture()
+{
+	if (bCustomCaptureIsTransient)
+	{
+		CustomCapture.SafeRelease();
+		bCustomCaptureIsTransient = false;
+	}
+}
+
+FRHITexture* FSceneRenderTargets::GetCustomCaptureAttachmentDummy(FRHICommandList& RHICmdList)
+{
+	// Same format as a capture drawn in the scene color pass, never loaded or stored
+	FPooledRenderTargetDesc Desc(FPooledRenderTargetDesc::Create2DDesc(BufferSize, GetCustomCaptureFormat(CW_RGBA), FClearValueBinding::Black, TexCreate_None, TexCreate_RenderTargetable | TexCreate_Memoryless, false));
+	GRenderTargetPool.FindFreeElement(RHICmdList, Desc, CustomCaptureAttachmentDummy, TEXT("CustomCaptureAttachmentDummy"));
+	return CustomCaptureAttachmentDummy->GetRenderTargetItem().TargetableTexture;
+}
+
 FCustomDepthTextures FSceneRenderTargets::RequestCustomDepth(FRDGBuilder& GraphBuilder, bool bPrimitives)
 {
 	FCustomDepthTextures CustomDepthTextures{};
@@ -2546,9 +2716,18 @@ static void SetupMobileSceneTextureUniformParameters(
 	
 	// Custom Capture
 	{
-		const FSceneRenderTargetItem& CaptureToUse = SceneContext.CustomCapture ? SceneContext.CustomCapture->GetRenderTargetItem() : GSystemTextures.BlackDummy->GetRenderTargetItem();
-		SceneTextureParameters.CustomCaptureTexture = CaptureToUse.ShaderResourceTexture;
-		SceneTextureParameters.CustomCaptureTextureSampler = TStaticSamplerState<>::GetRHI();
+		// Can't be sampled while it is an attachment of the scene color pass
+		const bool bUseCustomCapture = SceneContext.CustomCapture && !SceneContext.bCustomCaptureAttached;
+		// Multi-view applications capture into an array, one slice per eye
+		const bool bCustomCaptureArray = bUseCustomCapture && SceneContext.CustomCapture->GetDesc().bIsArray;
+		SceneTextureParameters.CustomCaptureTexture = (bUseCustomCapture && !bCustomCaptureArray) ? GetRDG(SceneContext.CustomCapture) : BlackDefault2D;
+		SceneTextureParameters.CustomCaptureTextureArray = bCustomCaptureArray ? GetRDG(SceneContext.CustomCapture) : GetRDG(GCustomCaptureBlackArrayDummy.GetTexture());
+		SceneTextureParameters.CustomCaptureTextureSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+		SceneTextureParameters.CustomCaptureUVScale = bUseCustomCapture ? SceneContext.CustomCaptureUVScale : FVector2D(1.0f, 1.0f);
+		SceneTextureParameters.CustomCaptureUVRect = bUseCustomCapture ? SceneContext.CustomCaptureUVRect : FVector4(0.0f, 0.0f, 0.0f, 0.0f);
+		SceneTextureParameters.CustomCaptureClipToCaptureClip = SceneContext.CustomCaptureClipToCaptureClip;
+		SceneTextureParameters.CustomCaptureReproject = (bUseCustomCapture && SceneContext.bCustomCaptureReproject) ? 1.0f : 0.0f;
+		SceneTextureParameters.CustomCaptureChannelScale = GetCustomCaptureChannelScale(bUseCustomCapture ? SceneContext.CustomCapture->GetDesc().Format : PF_Unknown);
 	}
 
 }
@@ -146,7 +146,11 @@ struct FCustomDepthTextures
 
 struct FCustomCaptureTextures
 {
-	FTextureRHIRef CustomColor{};
+	FRDGTextureRef CustomColor{};
+	// Fraction of the scene buffer resolution the capture is rendered at
+	float ResolutionScale = 1.0f;
+	// The target was kept from a previous frame and still holds its capture
+	bool bHistoryValid = false;
 };
 
 /**
@@ -178,6 +182,16 @@ protected:
 	FSceneRenderTargets() :
 		bScreenSpaceAOIsValid(false),
 		bCustomDepthIsValid(false),
+		CustomCaptureUVScale(1.0f, 1.0f),
+		CustomCaptureUVRect(0.0f, 0.0f, 1.0f, 1.0f),
+		CustomCaptureClipToCaptureClip(FMatrix::Identity),
+		bCustomCaptureReproject(false),
+		CustomCaptureViewKey(0),
+		CustomCaptureFrameNumber(0),
+		CustomCaptureRotatedView(0),
+		CustomCaptureViewProjectionMatrix(FMatrix::Identity),
+		bCustomCaptureIsTransient(false),
+		bCustomCaptureAttached(false),
 		GBufferRefCount(0),
 		ThisFrameNumber(0),
 		CurrentDesiredSizeIndex(0),
@@ -353,9 +367,17 @@ public:
 		return (const FTexture2DRHIRef&)DirectionalOcclusion->GetRenderTargetItem().TargetableTexture; 
 	}
 
+	// @param ChannelMask capture channels the target format needs to hold, bit N being channel N
+	// @param MultiViewCount number of slices of a multi-view capture, 0 for a plain 2D capture
 	// @return can be empty if the feature is disabled
-	FCustomCaptureTextures RequestCustomCapture(FRDGBuilder& GraphBuilder, bool bPrimitives);
-	FCustomCaptureTextures RequestCustomCapture(FRHICommandListImmediate& RHICmdList, bool bPrimitives);
+	/** bKeepHistory keeps the capture for later frames, bExternal makes it available outside of the graph for this frame only. */
+	FCustomCaptureTextures RequestCustomCapture(FRDGBuilder& GraphBuilder, bool bPrimitives, uint8 ChannelMask = 1, bool bKeepHistory = false, bool bExternal = false, uint32 MultiViewCount = 0);
+	/** Whether the kept capture can be reused by a capture of these channels, checked before the capture pass is set up. */
+	bool CanReuseCustomCapture(uint8 ChannelMask, uint32 MultiViewCount) const;
+	/** Hands a capture that isn't kept for later frames back to the pool, once the last pass reading it has been set up. */
+	void ReleaseTransientCustomCapture();
+	/** Memoryless stand-in for the capture attachment of the mobile scene color pass, on frames the capture isn't drawn there. */
+	FRHITexture* GetCustomCaptureAttachmentDummy(FRHICommandList& RHICmdList);
 
 	// @return can be empty if the feature is disabled
 	FCustomDepthTextures RequestCustomDepth(FRDGBuilder& GraphBuilder, bool bPrimitives);
@@ -510,6 +532,8 @@ public:
 	TRefCountPtr<IPooledRenderTarget> MobileCustomStencil;
 	// used by CustomCapture pass
 	TRefCountPtr<IPooledRenderTarget> CustomCapture;
+	// bound in place of CustomCapture to keep the mobile scene color pass layout
+	TRefCountPtr<IPooledRenderTarget> CustomCaptureAttachmentDummy;
 	// used by the CustomDepth material feature for stencil
 	TRefCountPtr<FRHIShaderResourceView> CustomStencilSRV;
 
@@ -542,6 +566,37 @@ public:
 	// todo: free ScreenSpaceAO so pool can reuse
 	bool bCustomDepthIsValid;
 
+	// Maps scene texture UVs onto CustomCapture, which may be rendered at a fraction of BufferSize
+	FVector2D CustomCaptureUVScale;
+
+	// Scene texture UV rect (min xy, max xy) covered by the capture primitives of the view set up by SetCustomCaptureView, CustomCapture is only valid inside of it
+	FVector4 CustomCaptureUVRect;
+
+	// CustomCaptureUVRect of every view, kept along with the capture
+	TArray<FVector4, TInlineAllocator<2>> CustomCaptureViewUVRects;
+
+	/** Selects the capture rect of a view for the scene texture uniform buffers set up next, INDEX_NONE for none. */
+	void SetCustomCaptureView(int32 ViewIndex)
+	{
+		CustomCaptureUVRect = CustomCaptureViewUVRects.IsValidIndex(ViewIndex) ? CustomCaptureViewUVRects[ViewIndex] : FVector4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	// Maps the current clip space onto the clip space CustomCapture was rendered in, used when bCustomCaptureReproject is set
+	FMatrix CustomCaptureClipToCaptureClip;
+	bool bCustomCaptureReproject;
+
+	// State of the last CustomCapture refresh, see r.Mobile.CustomCapture.UpdateInterval
+	uint32 CustomCaptureViewKey;
+	uint32 CustomCaptureFrameNumber;
+	uint32 CustomCaptureRotatedView;
+	FMatrix CustomCaptureViewProjectionMatrix;
+
+	// CustomCapture was extracted from the graph for this frame only
+	bool bCustomCaptureIsTransient;
+
+	// CustomCapture is the second attachment of the scene color pass, the scene texture uniform buffers created until the end of the pass fall back to black
+	bool bCustomCaptureAttached;
+
 private:
 	/** used by AdjustGBufferRefCount */
 	int32 GBufferRefCount;
@@ -574,6 +629,9 @@ private:
 	/** Allocates render targets for use with the mobile path. */
 	void AllocateMobileRenderTargets(FRHICommandListImmediate& RHICmdList);
 
+	/** Desc of a CustomCapture holding these channels at the current buffer size. */
+	FRDGTextureDesc GetCustomCaptureDesc(uint8 ChannelMask, uint32 MultiViewCount) const;
+
 public:
 	/** Allocates render targets for use with the deferred shading path. */
 	// Temporarily Public to call from DefferedShaderRenderer to attempt recovery from a crash until cause is found.
@@ -66,6 +66,7 @@
 #include "Rendering/StaticLightingSystemInterface.h"
 #endif
 #include "FXSystem.h"
+#include "CustomCapturePass.h"
 
 /*-----------------------------------------------------------------------------
 	Globals
@@ -525,6 +526,13 @@ void FRDGParallelCommandListSet::SetStateOnCommandList(FRHICommandList& RHICmdLi
 	FParallelCommandListSet::SetStateOnCommandList(RHICmdList);
 	Bindings.SetOnCommandList(RHICmdList);
 	SceneRenderer.SetStereoViewport(RHICmdList, View, ViewportScale);
+
+	// Command lists are set up in submission order
+	if (bClearInFirstCommandListOnly)
+	{
+		Bindings.LoadClearedColorRenderTargets();
+		bClearInFirstCommandListOnly = false;
+	}
 }
 
 FFastVramConfig::FFastVramConfig()
@@ -898,10 +906,17 @@ void FViewInfo::Init()
 	bUseComputePasses = IsPostProcessingWithComputeEnabled(FeatureLevel);
 	bHasCustomDepthPrimitives = false;
 	bHasCustomCapturePrimitives = false;
+	bHasCustomCaptureGPUParticles = false;
+	CustomCaptureChannelMask = 0;
+	CustomCaptureRect = FIntRect();
+	NumCustomCaptureDraws = 0;
 	bHasDistortionPrimitives = false;
 	bAllowStencilDither = false;
 	bCustomDepthStencilValid = false;
 	bUsesCustomDepthStencilInTranslucentMaterials = false;
+	bUsesCustomCaptureInMaterials = false;
+	bCustomCaptureValid = false;
+	bCustomCaptureRefresh = true;
 	bShouldRenderDepthToTranslucency = false;
 
 	ForwardLightingResources = nullptr;
@@ -3233,6 +3248,12 @@ void FSceneRenderer::SetupMeshPass(FViewInfo& View, FExclusiveDepthStencil::Type
 				continue;
 			}
 
+			// Custom capture: skip the whole pass setup when nothing samples the capture this frame, or when the kept capture is reused.
+			if (PassType == EMeshPass::CustomCapturePass && (!View.bCustomCaptureValid || !View.bCustomCaptureRefresh))
+			{
+				continue;
+			}
+
 			if (ViewFamily.UseDebugViewPS() && ShadingPath == EShadingPath::Deferred)
 			{
 				switch (PassType)
@@ -3256,6 +3277,13 @@ void FSceneRenderer::SetupMeshPass(FViewInfo& View, FExclusiveDepthStencil::Type
 
 			FParallelMeshDrawCommandPass& Pass = View.ParallelMeshDrawCommandPasses[PassIndex];
 
+			if (PassType == EMeshPass::CustomCapturePass)
+			{
+				UpdateCustomCaptureTranslucentSortKeys(Scene, View, ViewCommands.MeshCommands[PassIndex]);
+				View.NumCustomCaptureDraws = ViewCommands.MeshCommands[PassIndex].Num() + View.NumVisibleDynamicMeshElements[PassType];
+				UpdateCustomCaptureDrawStats(View, ViewCommands.MeshCommands[PassIndex], View.NumVisibleDynamicMeshElements[PassType]);
+			}
+
 			if (ShouldDumpMeshDrawCommandInstancingStats())
 			{
 				Pass.SetDumpInstancingStats(GetMeshPassName(PassType));
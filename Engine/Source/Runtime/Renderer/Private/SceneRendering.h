@@ -492,6 +492,19 @@ public:
 		RHICmdList.SetGlobalUniformBuffers(GlobalUniformBuffers);
 	}
 
+	/** Loads the color targets the render pass would clear, for the render passes following the one that cleared them. */
+	inline void LoadClearedColorRenderTargets()
+	{
+		for (int32 Index = 0; Index < MaxSimultaneousRenderTargets; ++Index)
+		{
+			FRHIRenderPassInfo::FColorEntry& ColorEntry = RenderPassInfo.ColorRenderTargets[Index];
+			if (ColorEntry.RenderTarget && GetLoadAction(ColorEntry.Action) == ERenderTargetLoadAction::EClear)
+			{
+				ColorEntry.Action = MakeRenderTargetActions(ERenderTargetLoadAction::ELoad, GetStoreAction(ColorEntry.Action));
+			}
+		}
+	}
+
 	FRHIRenderPassInfo RenderPassInfo;
 	FUniformBufferStaticBindings GlobalUniformBuffers;
 };
@@ -560,6 +573,7 @@ public:
 		, SceneRenderer(InSceneRenderer)
 		, Bindings(InBindings)
 		, ViewportScale(InViewportScale)
+		, bClearInFirstCommandListOnly(false)
 	{}
 
 	~FRDGParallelCommandListSet() override
@@ -569,10 +583,14 @@ public:
 
 	void SetStateOnCommandList(FRHICommandList& RHICmdList) override;
 
+	/** Only the render pass of the first command list clears the targets, the render passes of the following ones load them. */
+	void SetClearInFirstCommandListOnly() { bClearInFirstCommandListOnly = true; }
+
 private:
 	const FSceneRenderer& SceneRenderer;
 	FParallelCommandListBindings Bindings;
 	float ViewportScale;
+	bool bClearInFirstCommandListOnly;
 };
 
 enum EVolumeUpdateType
@@ -1088,6 +1106,12 @@ public:
 	/** The dynamic primitives with simple lights visible in this view. */
 	TArray<FPrimitiveSceneInfo*, SceneRenderingAllocator> VisibleDynamicPrimitivesWithSimpleLights;
 
+	/**
+	 * The visible primitives only rendered in the custom capture, their components count as rendered on the frames the capture is refreshed.
+	 * Gathered per view during relevance, it is not a scene-wide list of the capture primitives.
+	 */
+	TArray<FPrimitiveSceneInfo*, SceneRenderingAllocator> CustomCaptureOnlyPrimitives;
+
 	/** Number of dynamic primitives visible in this view. */
 	int32 NumVisibleDynamicPrimitives;
 
@@ -1112,6 +1136,14 @@ public:
 	bool bHasDistortionPrimitives;
 	bool bHasCustomDepthPrimitives;
 	bool bHasCustomCapturePrimitives;
+	/** Whether some custom capture primitives draw GPU simulated particles, their buffers are complete after the FX system rendered the frame. */
+	bool bHasCustomCaptureGPUParticles;
+	/** Union of the capture channels written by the visible custom capture primitives. */
+	uint8 CustomCaptureChannelMask;
+	/** Union of the projected bounds of the visible custom capture primitives, in pixels. */
+	FIntRect CustomCaptureRect;
+	/** Number of custom capture mesh draw commands of the view, before dynamic instancing. */
+	int32 NumCustomCaptureDraws;
 
 	/** Mesh batches with for mesh decal rendering. */
 	TArray<FMeshDecalBatch, SceneRenderingAllocator> MeshDecalBatches;
@@ -1244,6 +1276,12 @@ public:
 	uint32 bUsesSceneDepth : 1;
 	uint32 bCustomDepthStencilValid : 1;
 	uint32 bUsesCustomDepthStencilInTranslucentMaterials : 1;
+	/** Whether any relevant material in the view samples PPI_CustomCapture. */
+	uint32 bUsesCustomCaptureInMaterials : 1;
+	/** Whether the custom capture pass has both primitives and a consumer in this view. */
+	uint32 bCustomCaptureValid : 1;
+	/** Whether the capture of this view is drawn this frame, otherwise the kept capture is reused and the pass isn't set up. */
+	uint32 bCustomCaptureRefresh : 1;
 	uint32 bShouldRenderDepthToTranslucency : 1;
 
 	/** Whether fog should only be computed on rendered opaque pixels or not. */
@@ -1962,6 +2000,9 @@ protected:
 	void ComputeViewVisibility(FRHICommandListImmediate& RHICmdList, FExclusiveDepthStencil::Type BasePassDepthStencilAccess, FViewVisibleCommandsPerView& ViewCommandsPerView, 
 		FGlobalDynamicIndexBuffer& DynamicIndexBuffer, FGlobalDynamicVertexBuffer& DynamicVertexBuffer, FGlobalDynamicReadBuffer& DynamicReadBuffer);
 
+	/** Decides which views draw their custom capture this frame, before the capture pass is set up. */
+	void SetupCustomCaptureRefresh(FRHICommandListImmediate& RHICmdList);
+
 	/** Performs once per frame setup after to visibility determination. */
 	void PostVisibilityFrameSetup(FILCUpdatePrimTaskData& OutILCTaskData);
 
@@ -2138,7 +2179,16 @@ protected:
 	void RenderMobileBasePass(FRHICommandListImmediate& RHICmdList, const TArrayView<const FViewInfo*> PassViews);
 	
 	/** Renders the custom capture pass for mobile. */
-	void RenderCustomCapturePass(FRHICommandListImmediate& RHICmdList, const TArrayView<const FViewInfo*> PassViews);
+	void RenderCustomCapturePass(FRDGBuilder& GraphBuilder, const TArrayView<const FViewInfo*> PassViews);
+
+	/** Whether the scene color pass has the custom capture attachment, drawn to or not. */
+	bool CanRenderCustomCaptureInSceneColorPass() const;
+
+	/** Renders the custom capture to the second attachment of the scene color pass, at the end of the pass. */
+	void RenderCustomCaptureInSceneColorPass(FRHICommandListImmediate& RHICmdList, const TArrayView<const FViewInfo*> PassViews);
+
+	/** Binds the capture of the previous frame to the materials drawn before a capture rendered after the FX system. */
+	void UseCustomCaptureHistoryUntilRendered(FRHICommandListImmediate& RHICmdList);
 
 	void RenderMobileEditorPrimitives(FRHICommandList& RHICmdList, const FViewInfo& View, const FMeshPassProcessorRenderState& DrawRenderState);
 
@@ -2183,6 +2233,7 @@ protected:
 
 	void UpdateOpaqueBasePassUniformBuffer(FRHICommandListImmediate& RHICmdList, const FViewInfo& View);
 	void UpdateTranslucentBasePassUniformBuffer(FRHICommandListImmediate& RHICmdList, const FViewInfo& View);
+	void UpdateBasePassUniformBuffersForCustomCapture(FRHICommandListImmediate& RHICmdList);
 	void UpdateDirectionalLightUniformBuffers(FRHICommandListImmediate& RHICmdList, const FViewInfo& View);
 	void UpdateSkyReflectionUniformBuffer();
 
@@ -2219,6 +2270,9 @@ private:
 	bool bSubmitOffscreenRendering;
 	bool bModulatedShadowsInUse;
 	bool bShouldRenderCustomDepth;
+	bool bShouldRenderCustomCapture;
+	bool bRenderCustomCaptureInSceneColorPass;
+	bool bRenderCustomCaptureAfterFX;
 	bool bRequiresPixelProjectedPlanarRelfectionPass;
 	bool bRequiresAmbientOcclusionPass;
 	bool bRequiresDistanceField;
@@ -38,6 +38,7 @@
 #include "TranslucentRendering.h"
 #include "Async/ParallelFor.h"
 #include "HairStrands/HairStrandsRendering.h"
+#include "CustomCapturePass.h"
 #include "RectLightSceneProxy.h"
 #include "Math/Halton.h"
 #include "ProfilingDebugging/DiagnosticTable.h"
@@ -1895,6 +1896,7 @@ struct FRelevancePacket
 	FRelevancePrimSet<int32> NotDrawRelevant;
 	FRelevancePrimSet<int32> TranslucentSelfShadowPrimitives;
 	FRelevancePrimSet<FPrimitiveSceneInfo*> VisibleDynamicPrimitivesWithSimpleLights;
+	FRelevancePrimSet<FPrimitiveSceneInfo*> CustomCaptureOnlyPrimitives;
 	int32 NumVisibleDynamicPrimitives;
 	int32 NumVisibleDynamicEditorPrimitives;
 	FMeshPassMask VisibleDynamicMeshesPassMask;
@@ -1902,6 +1904,9 @@ struct FRelevancePacket
 	bool bHasDistortionPrimitives;
 	bool bHasCustomDepthPrimitives;
 	bool bHasCustomCapturePrimitives;
+	bool bHasCustomCaptureGPUParticles;
+	uint8 CustomCaptureChannelMask;
+	FIntRect CustomCaptureRect;
 	FRelevancePrimSet<FPrimitiveSceneInfo*> LazyUpdatePrimitives;
 	FRelevancePrimSet<FPrimitiveSceneInfo*> DirtyIndirectLightingCacheBufferPrimitives;
 	FRelevancePrimSet<FPrimitiveSceneInfo*> RecachedReflectionCapturePrimitives;
@@ -1967,12 +1972,15 @@ struct FRelevancePacket
 		, bHasDistortionPrimitives(false)
 		, bHasCustomDepthPrimitives(false)
 		, bHasCustomCapturePrimitives(false)
+		, bHasCustomCaptureGPUParticles(false)
+		, CustomCaptureChannelMask(0)
 		, CombinedShadingModelMask(0)
 		, bUsesGlobalDistanceField(false)
 		, bUsesLightingChannels(false)
 		, bTranslucentSurfaceLighting(false)
 		, bUsesSceneDepth(false)
 		, bUsesCustomDepthStencil(false)
+		, bUsesCustomCapture(false)
 		, bShouldRenderDepthToTranslucency(false)
 		, bSceneHasSkyMaterial(false)
 		, bHasSingleLayerWaterMaterial(false)
@@ -2007,6 +2015,21 @@ struct FRelevancePacket
 			ViewRelevance = PrimitiveSceneInfo->Proxy->GetViewRelevance(&View);
 			ViewRelevance.bInitializedThisFrame = true;
 
+			// A primitive captured in no channel draws nothing in the capture, it doesn't need the capture pass either
+			const bool bHasCustomCaptureChannels = PrimitiveSceneInfo->Proxy->GetCustomCaptureChannelMask() != 0;
+			ViewRelevance.bRenderCustomCapture &= bHasCustomCaptureChannels;
+
+			// IsShown() hides primitives only visible in the custom capture, they skip the view and only feed the capture pass
+			if (!ViewRelevance.bDrawRelevance && !View.bIsSceneCapture && PrimitiveSceneInfo->Proxy->IsVisibleInCustomCaptureOnly())
+			{
+				if (bHasCustomCaptureChannels && PrimitiveSceneInfo->Proxy->IsShownInCustomCapture(&View))
+				{
+					AddCustomCaptureOnlyPrimitive(BitIndex, PrimitiveSceneInfo, ViewRelevance);
+				}
+				NotDrawRelevant.AddPrim(BitIndex);
+				continue;
+			}
+
 			const bool bStaticRelevance = ViewRelevance.bStaticRelevance;
 			const bool bDrawRelevance = ViewRelevance.bDrawRelevance;
 			const bool bDynamicRelevance = ViewRelevance.bDynamicRelevance;
@@ -2110,7 +2133,7 @@ struct FRelevancePacket
 
 			if (ViewRelevance.bRenderCustomCapture)
 			{
-				bHasCustomCapturePrimitives = true;
+				AddCustomCapturePrimitive(BitIndex, PrimitiveSceneInfo, ViewRelevance);
 			}
 
 			extern bool GUseTranslucencyShadowDepths;
@@ -2158,6 +2181,60 @@ struct FRelevancePacket
 		}
 	}
 
+	void AddCustomCapturePrimitive(int32 BitIndex, FPrimitiveSceneInfo* PrimitiveSceneInfo, const FPrimitiveViewRelevance& ViewRelevance)
+	{
+		const FIntRect PrimitiveRect = ComputeCustomCaptureScreenRect(View, Scene->PrimitiveBounds[BitIndex].BoxSphereBounds);
+		if (bHasCustomCapturePrimitives)
+		{
+			CustomCaptureRect.Union(PrimitiveRect);
+		}
+		else
+		{
+			CustomCaptureRect = PrimitiveRect;
+		}
+		bHasCustomCapturePrimitives = true;
+		bHasCustomCaptureGPUParticles |= ViewRelevance.bCustomCaptureGPUParticles;
+		CustomCaptureChannelMask |= PrimitiveSceneInfo->Proxy->GetCustomCaptureChannelMask();
+	}
+
+	/**
+	 * Routes a primitive hidden from the view to its custom capture pass, none of the other passes of the view consider it.
+	 * Capture primitives are still found by the per-primitive relevance scan, the scene keeps no list of them.
+	 */
+	void AddCustomCaptureOnlyPrimitive(int32 BitIndex, FPrimitiveSceneInfo* PrimitiveSceneInfo, FPrimitiveViewRelevance& ViewRelevance)
+	{
+		ViewRelevance.bCustomCaptureOnly = true;
+		ViewRelevance.bShadowRelevance = false;
+		ViewRelevance.bVelocityRelevance = false;
+		ViewRelevance.bHasSimpleLights = false;
+		ViewRelevance.bTranslucentSelfShadow = false;
+
+		if (ViewRelevance.bStaticRelevance)
+		{
+			RelevantStaticPrimitives.AddPrim(BitIndex);
+		}
+
+		if (ViewRelevance.bDynamicRelevance && !ViewRelevance.bEditorPrimitiveRelevance)
+		{
+			++NumVisibleDynamicPrimitives;
+			OutHasDynamicMeshElementsMasks[BitIndex] |= ViewBit;
+		}
+
+		AddCustomCapturePrimitive(BitIndex, PrimitiveSceneInfo, ViewRelevance);
+
+		// Only seen through the capture, the component is marked rendered once the capture is refreshed.
+		// Its simulation idles between refreshes and while nothing samples the capture.
+		if (View.PrimitiveDefinitelyUnoccludedMap[BitIndex])
+		{
+			CustomCaptureOnlyPrimitives.AddPrim(PrimitiveSceneInfo);
+		}
+
+		if (PrimitiveSceneInfo->NeedsUniformBufferUpdate())
+		{
+			LazyUpdatePrimitives.AddPrim(PrimitiveSceneInfo);
+		}
+	}
+
 	void MarkRelevant()
 	{
 		SCOPE_CYCLE_COUNTER(STAT_StaticRelevance);
@@ -2171,6 +2248,9 @@ struct FRelevancePacket
 		const bool bHLODActive = Scene->SceneLODHierarchy.IsActive();
 		const FHLODVisibilityState* const HLODState = bHLODActive && ViewState ? &ViewState->HLODVisibilityState : nullptr;
 
+		// Depth tested capture draws depend on runtime settings, their commands are built for each view
+		const bool bCacheCustomCapture = !IsCustomCaptureDepthTested(Scene);
+
 		for (int32 StaticPrimIndex = 0, Num = RelevantStaticPrimitives.NumPrims; StaticPrimIndex < Num; ++StaticPrimIndex)
 		{
 			int32 PrimitiveIndex = RelevantStaticPrimitives.Prims[StaticPrimIndex];
@@ -2250,7 +2330,16 @@ struct FRelevancePacket
 					const bool bIsMeshDitheringLOD = StaticMeshRelevance.bDitheredLODTransition && (MarkMask & (EMarkMaskBits::StaticMeshFadeOutDitheredLODMapMask | EMarkMaskBits::StaticMeshFadeInDitheredLODMapMask));
 					const bool bCanCache = !bIsPrimitiveDistanceCullFading && !bIsMeshDitheringLOD;
 					
-					if (ViewRelevance.bDrawRelevance)
+					if (ViewRelevance.bCustomCaptureOnly)
+					{
+						// None of the other passes draw the primitive, their commands are not even considered
+						if (StaticMeshRelevance.bUseForMaterial && !bHiddenByHLODFade)
+						{
+							DrawCommandPacket.AddCommandsForMesh(PrimitiveIndex, PrimitiveSceneInfo, StaticMeshRelevance, StaticMesh, Scene, bCanCache && bCacheCustomCapture, EMeshPass::CustomCapturePass);
+							++NumVisibleStaticMeshElements;
+						}
+					}
+					else if (ViewRelevance.bDrawRelevance)
 					{
 						if ((StaticMeshRelevance.bUseForMaterial || StaticMeshRelevance.bUseAsOccluder)
 							&& (ViewRelevance.bRenderInMainPass || ViewRelevance.bRenderCustomDepth || ViewRelevance.bRenderCustomCapture || ViewRelevance.bRenderInDepthPass)
@@ -2321,7 +2410,7 @@ struct FRelevancePacket
 								// CUSTOM CAPTURE MESH PASS
 								if (ViewRelevance.bRenderCustomCapture)
 								{
-									DrawCommandPacket.AddCommandsForMesh(PrimitiveIndex, PrimitiveSceneInfo, StaticMeshRelevance, StaticMesh, Scene, bCanCache, EMeshPass::CustomCapturePass);
+									DrawCommandPacket.AddCommandsForMesh(PrimitiveIndex, PrimitiveSceneInfo, StaticMeshRelevance, StaticMesh, Scene, bCanCache && bCacheCustomCapture, EMeshPass::CustomCapturePass);
 								}
 
 								if (bAddLightmapDensityCommands)
@@ -2482,6 +2571,7 @@ struct FRelevancePacket
 		WriteView.bHasSingleLayerWaterMaterial |= bHasSingleLayerWaterMaterial;
 		WriteView.bHasTranslucencySeparateModulation |= bHasTranslucencySeparateModulation;
 		VisibleDynamicPrimitivesWithSimpleLights.AppendTo(WriteView.VisibleDynamicPrimitivesWithSimpleLights);
+		CustomCaptureOnlyPrimitives.AppendTo(WriteView.CustomCaptureOnlyPrimitives);
 		WriteView.NumVisibleDynamicPrimitives += NumVisibleDynamicPrimitives;
 		WriteView.NumVisibleDynamicEditorPrimitives += NumVisibleDynamicEditorPrimitives;
 		WriteView.TranslucentPrimCount.Append(TranslucentPrimCount);
@@ -2489,7 +2579,21 @@ struct FRelevancePacket
 		WriteView.bHasCustomDepthPrimitives |= bHasCustomDepthPrimitives;
 		WriteView.bUsesCustomDepthStencilInTranslucentMaterials |= bUsesCustomDepthStencil;
 		WriteView.bShouldRenderDepthToTranslucency |= bShouldRenderDepthToTranslucency;
+		if (bHasCustomCapturePrimitives)
+		{
+			if (WriteView.bHasCustomCapturePrimitives)
+			{
+				WriteView.CustomCaptureRect.Union(CustomCaptureRect);
+			}
+			else
+			{
+				WriteView.CustomCaptureRect = CustomCaptureRect;
+			}
+		}
 		WriteView.bHasCustomCapturePrimitives |= bHasCustomCapturePrimitives;
+		WriteView.bHasCustomCaptureGPUParticles |= bHasCustomCaptureGPUParticles;
+		WriteView.CustomCaptureChannelMask |= CustomCaptureChannelMask;
+		WriteView.bUsesCustomCaptureInMaterials |= bUsesCustomCapture;
 		DirtyIndirectLightingCacheBufferPrimitives.AppendTo(WriteView.DirtyIndirectLightingCacheBufferPrimitives);
 
 		WriteView.MeshDecalBatches.Append(MeshDecalBatches);
@@ -2720,6 +2824,13 @@ void ComputeDynamicMeshRelevance(EShadingPath ShadingPath, bool bAddLightmapDens
 {
 	const int32 NumElements = MeshBatch.Mesh->Elements.Num();
 
+	if (ViewRelevance.bCustomCaptureOnly)
+	{
+		PassMask.Set(EMeshPass::CustomCapturePass);
+		View.NumVisibleDynamicMeshElements[EMeshPass::CustomCapturePass] += NumElements;
+		return;
+	}
+
 	if (ViewRelevance.bDrawRelevance && (ViewRelevance.bRenderInMainPass || ViewRelevance.bRenderCustomDepth || ViewRelevance.bRenderCustomCapture || ViewRelevance.bRenderInDepthPass))
 	{
 		PassMask.Set(EMeshPass::DepthPass);
@@ -3821,6 +3932,13 @@ void FSceneRenderer::ComputeViewVisibility(FRHICommandListImmediate& RHICmdList,
 
 		Scene->ConditionalMarkStaticMeshElementsForUpdate();
 
+		// Primitives captured at runtime only get their CustomCapturePass commands cached, once
+		if (Scene->PrimitivesNeedingCustomCaptureUpdate.Num() > 0)
+		{
+			CacheCustomCaptureMeshDrawCommands(Scene, Scene->PrimitivesNeedingCustomCaptureUpdate);
+			Scene->PrimitivesNeedingCustomCaptureUpdate.Reset();
+		}
+
 		TArray<FPrimitiveSceneInfo*> UpdatedSceneInfos;
 		for (TSet<FPrimitiveSceneInfo*>::TIterator It(Scene->PrimitivesNeedingStaticMeshUpdateWithoutVisibilityCheck); It; ++It)
 		{
@@ -4135,6 +4253,19 @@ void FSceneRenderer::ComputeViewVisibility(FRHICommandListImmediate& RHICmdList,
 			HasDynamicMeshElementsMasks, HasDynamicEditorMeshElementsMasks, MeshCollector);
 	}
 
+	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+	{
+		FViewInfo& View = Views[ViewIndex];
+		if (View.ShouldRenderView())
+		{
+			// Needs the final material relevance of the view, so it can only be decided once all relevance packets are merged.
+			View.bCustomCaptureValid = UsesCustomCaptureLookup(Scene, View);
+		}
+	}
+
+	// Frames reusing the kept capture skip the setup of the capture pass
+	SetupCustomCaptureRefresh(RHICmdList);
+
 	for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
 	{
 		FViewInfo& View = Views[ViewIndex];
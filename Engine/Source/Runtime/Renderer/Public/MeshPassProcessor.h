@@ -1080,6 +1080,14 @@ public:
 			uint64 VertexShaderHash : 32;	// Order by vertex shader's hash.
 			uint64 PixelShaderHash : 32;	// First order by pixel shader's hash.
 		} Generic;
+
+		struct
+		{
+			uint64 VertexFactoryHash	: 16; // Order by vertex factory, draws of the same mesh can be merged.
+			uint64 BlendState			: 8;  // Order by channel mask and blend.
+			uint64 VertexShaderHash		: 16; // Order by vertex shader's hash.
+			uint64 PixelShaderHash		: 24; // First order by pixel shader's hash.
+		} CustomCapture;
 	};
 
 	FORCEINLINE bool operator!=(FMeshDrawCommandSortKey B) const
@@ -100,8 +100,14 @@ BEGIN_GLOBAL_SHADER_PARAMETER_STRUCT(FMobileSceneTextureUniformParameters, RENDE
 	SHADER_PARAMETER_SAMPLER(SamplerState, GBufferDTextureSampler)
 	SHADER_PARAMETER_SAMPLER(SamplerState, SceneDepthAuxTextureSampler)
 	// Custom Capture
-	SHADER_PARAMETER_TEXTURE(Texture2D, CustomCaptureTexture)
+	SHADER_PARAMETER_RDG_TEXTURE(Texture2D, CustomCaptureTexture)
+	SHADER_PARAMETER_RDG_TEXTURE(Texture2DArray, CustomCaptureTextureArray)
 	SHADER_PARAMETER_SAMPLER(SamplerState, CustomCaptureTextureSampler)
+	SHADER_PARAMETER(FVector2D, CustomCaptureUVScale)
+	SHADER_PARAMETER(FVector4, CustomCaptureUVRect)
+	SHADER_PARAMETER(FMatrix, CustomCaptureClipToCaptureClip)
+	SHADER_PARAMETER(float, CustomCaptureReproject)
+	SHADER_PARAMETER(FVector4, CustomCaptureChannelScale)
 END_GLOBAL_SHADER_PARAMETER_STRUCT()
 
 enum class EMobileSceneTextureSetupMode : uint32